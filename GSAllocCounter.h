@@ -0,0 +1,61 @@
+/*************************************************************************************************
+ * Allocation counter for the Priority-Flood Algorithm
+ *
+ * The scratch storage of GSFloodFill (Closed mask, Open and Pit queues, labels, copy buffer) is
+ * allocated through GSCountingAllocator, which adds the size of every allocation to a per-thread
+ * counter. GSFloodFill::Transform() reads the counter before and after the fill, so that a
+ * reused engine can show that it no longer allocates once its storage has grown to the size of
+ * its input.
+ *
+ * The counter is per thread, so that the bands that GSMultiBandFloodFill fills concurrently do
+ * not count each other's allocations.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSAllocCounter_H__
+#define   __GSAllocCounter_H__
+
+#include <cstddef>		// size_t
+#include <new>			// operator new
+
+typedef struct {
+	unsigned long long bytes;	// bytes allocated so far by this thread
+	unsigned long long count;	// number of allocations so far by this thread
+} GSAllocStats_t;
+
+inline GSAllocStats_t& GSAllocStats(void) {
+	static thread_local GSAllocStats_t stats = { 0, 0 };
+	return stats;
+}
+
+inline void GSCountAllocation(size_t bytes) {
+	GSAllocStats_t& stats = GSAllocStats();
+	stats.bytes += bytes;
+	stats.count++;
+}
+
+//
+// std::allocator that counts its allocations
+//
+template <typename T>
+class GSCountingAllocator {
+	public:
+		typedef T value_type;
+
+		GSCountingAllocator() { }
+		template <typename U> GSCountingAllocator(const GSCountingAllocator<U>&) { }
+
+		T* allocate(size_t n) {
+			GSCountAllocation(n * sizeof(T));
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void deallocate(T* p, size_t) { ::operator delete(p); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const GSCountingAllocator<T>&, const GSCountingAllocator<U>&) { return true; }
+template <typename T, typename U>
+inline bool operator!=(const GSCountingAllocator<T>&, const GSCountingAllocator<U>&) { return false; }
+
+#endif /* __GSAllocCounter_H__ */
@@ -0,0 +1,86 @@
+/*************************************************************************************************
+ * Closed mask for the Priority-Flood Algorithm
+ *
+ * One bit per cell, in a single allocation. The DEM is surrounded by a sentinel border of
+ * permanently closed cells, so that the neighbors of any cell of the DEM can be tested without
+ * checking whether they lie within the DEM:
+ *
+ *   - one sentinel row above and one below the DEM (plus one bit at either end, for the
+ *     diagonal neighbors of the first and of the last cell);
+ *   - when stride > cols, the padding cells cols..stride-1 of every row. The left neighbors of
+ *     column 0 then fall on the padding of the previous row, and the right neighbors of column
+ *     cols-1 on the padding of the same row.
+ *
+ * When stride == cols there is no room for padding: the left and right neighbors of the edge
+ * columns wrap onto the opposite edge column of the adjacent row. Those are edge cells of the
+ * DEM, which the priority-flood closes before it starts, so they are never processed twice.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSClosedMask_H__
+#define   __GSClosedMask_H__
+
+#include <cstdint>		// uint64_t, uint32_t
+#include <cstddef>		// size_t
+#include <algorithm>	// std::fill
+
+#include "GSAllocCounter.h"
+
+typedef bool Boolean;
+
+class GSClosedMask {
+	public:
+		GSClosedMask() : bits(NULL), nWords(0), capacity(0), origin(0) { }
+		~GSClosedMask() { delete [] bits; }
+
+		// Bits needed for a DEM of r rows whose rows are s cells apart
+		static unsigned long long nBits(int r, int s) {
+			return (unsigned long long) r * s + 2ULL * s + 2;
+		}
+
+		// Clears the mask for a DEM of r rows of c cells, s cells apart, and closes the sentinels.
+		// The bits are only reallocated when the mask grows.
+		void reset(int r, int c, int s) {
+			size_t n = (size_t) nBits(r, s);
+			nWords = (n + 63) / 64;
+			if (nWords > capacity) {
+				delete [] bits;
+				bits = new uint64_t [nWords];
+				capacity = nWords;
+				GSCountAllocation(nWords * sizeof(uint64_t));
+			}
+			std::fill(bits, bits + nWords, (uint64_t) 0);
+
+			origin = (uint32_t) s + 1;
+			for (uint32_t k = 0; k < origin; k++)			// top sentinel row
+				setBit(k);
+			for (size_t k = origin + (size_t) r * s; k < n; k++)	// bottom sentinel row
+				setBit(k);
+			if (s > c)
+				for (int i = 0; i < r; i++)					// padding of each row
+					for (int j = c; j < s; j++)
+						setBit(origin + (size_t) i * s + j);
+		}
+
+		// c is the linear index i * stride + j of a cell of the DEM or of one of its neighbors
+		Boolean isClosed(uint32_t c) const {
+			uint32_t k = c + origin;
+			return (bits[k >> 6] >> (k & 63)) & 1;
+		}
+		void close(uint32_t c) { setBit(c + origin); }
+
+		size_t bytes(void) const { return nWords * sizeof(uint64_t); }
+
+		GSClosedMask(const GSClosedMask&) = delete;
+		GSClosedMask& operator=(const GSClosedMask&) = delete;
+
+	private:
+		uint64_t *bits;
+		size_t nWords, capacity;
+		uint32_t origin;		// bit of cell 0
+
+		void setBit(size_t k) { bits[k >> 6] |= (uint64_t) 1 << (k & 63); }
+};
+
+#endif /* __GSClosedMask_H__ */
@@ -0,0 +1,82 @@
+/*************************************************************************************************
+ * GSFloodFill reuse check
+ *
+ * Fills a few DEMs of random elevations in turn, again and again, with one GSFloodFill engine
+ * per elevation type, rebound with setDEM(), and checks that every fill equals the fill of a
+ * fresh engine, and that once the engine has filled each DEM, it no longer allocates
+ * (getBytesAllocated() == 0): the queues, the Closed mask and the buffers must keep their
+ * storage from one Transform() to the next.
+ *
+ *     GSFloodReuseCheck [rows [cols [fills [dems]]]]
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#include "GSPriorityFlood.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdlib>		// atoi
+
+// Returns the number of failed fills of T, with the algorithm a
+template <typename T>
+static int check(const char* name, PFAlgorithm_t a, int rows, int cols, int fills, int dems) {
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> elevation(0, 120);
+	vector< vector<T> > inputs(dems, vector<T>((size_t) rows * cols));
+	GSFloodFill<T> floodFill;
+	int failed = 0;
+
+	for (int d=0; d<dems; d++)
+		for (size_t k=0; k<inputs[d].size(); k++)
+			inputs[d][k] = (T) elevation(random);
+
+	floodFill.setAlgorithm(a);
+	for (int f=0; f<fills; f++) {
+		vector<T> dem = inputs[f % dems];
+		vector<T> fresh = dem;
+		GSFloodFill<T> reference(& fresh[0], rows, cols);
+		reference.setAlgorithm(a);
+		reference.Transform();
+
+		floodFill.setDEM(& dem[0], rows, cols);
+		floodFill.Transform();
+		if (dem != fresh) {
+			std::cerr << name << ", algorithm " << a << ", fill " << f << ": differs from a fresh engine" << std::endl;
+			failed++;
+		}
+		if (f >= dems && floodFill.getBytesAllocated() != 0) {
+			std::cerr << name << ", algorithm " << a << ", fill " << f << ": " << floodFill.getBytesAllocated()
+				<< " bytes allocated by a reused engine" << std::endl;
+			failed++;
+		}
+	}
+	return failed;
+}
+
+int main(int argc, char *argv[]) {
+	int rows = (argc > 1)? atoi(argv[1]) : 500;
+	int cols = (argc > 2)? atoi(argv[2]) : 400;
+	int fills = (argc > 3)? atoi(argv[3]) : 20;
+	int dems = (argc > 4)? atoi(argv[4]) : 3;
+	int failed = 0;
+
+	if (rows <= 0 || cols <= 0 || dems <= 0 || fills <= dems) {
+		std::cerr << "Usage: GSFloodReuseCheck [rows [cols [fills [dems < fills]]]]" << std::endl;
+		return -1;
+	}
+
+	for (PFAlgorithm_t a : { PF_ORIGINAL, PF_IMPROVED }) {
+		failed += check<unsigned char>("unsigned char", a, rows, cols, fills, dems);
+		failed += check<unsigned short>("unsigned short", a, rows, cols, fills, dems);
+		failed += check<short>("short", a, rows, cols, fills, dems);
+		failed += check<int>("int", a, rows, cols, fills, dems);
+		failed += check<float>("float", a, rows, cols, fills, dems);
+		failed += check<double>("double", a, rows, cols, fills, dems);
+	}
+
+	std::cout << (failed? "FAILED" : "passed") << ": " << fills << " fills of " << dems << " DEMs of " << rows
+		<< 'x' << cols << " cells per type and algorithm." << std::endl;
+	return failed? -1 : 0;
+}
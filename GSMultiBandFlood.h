@@ -0,0 +1,163 @@
+/*************************************************************************************************
+ * Multi-band Priority-Flood
+ *
+ * GSMultiBandFloodFill flood-fills N independent planes of the same size (e.g. the R, G and B
+ * channels of a colour image, or the bands of a multispectral stack) concurrently. Up to
+ * `threads' bands are filled at the same time, each with GSFloodFill; when there are more
+ * threads than bands, the spare threads go to the tiled GSParallelFloodFill of each band that
+ * spans more than one tile (see GSParallelFloodFill::spansTiles).
+ *
+ * The object can be reused for a stream of images: setSize() and clearBands() rebind it, and the
+ * GSFloodFill engine of each band keeps its Closed mask and queue storage from call to call, as
+ * does the GSParallelFloodFill of each tiled band with its tile engines.
+ * With setPhase(), the fill of every band is timed as a phase of its own (see phase.h).
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSMultiBandFlood_H__
+#define   __GSMultiBandFlood_H__
+
+#include <vector>
+#include <memory>		// std::unique_ptr
+#include <thread>
+#include <algorithm>	// std::max
+
+#include "GSParallelFor.h"
+#include "phase.h"
+
+using namespace std;
+
+template <typename T, int Connectivity = 8>
+class GSMultiBandFloodFill {
+	public:
+
+		// Planes of r rows of c cells, consecutive rows `stride' elements apart, consecutive
+		// cells `pixStride' elements apart: the channels of an interleaved image are bands
+		// starting at base, base+1, ..., with pixStride the number of channels
+		GSMultiBandFloodFill(int r, int c, int stride = 0, int pixStride = 1);
+		void setSize(int r, int c, int stride = 0, int pixStride = 1);
+		void addBand(T* plane) { bands.push_back(plane); }
+		void clearBands(void) { bands.clear(); }
+		size_t nBands(void) { return bands.size(); }
+		Boolean Transform(void);
+
+		int verbose;
+		void setVerbose(int v) { verbose = v; }
+		PFAlgorithm_t algorithm;
+		void setAlgorithm(PFAlgorithm_t a) { algorithm = a; }
+		PFLayout_t layout;		// of the bands filled by GSFloodFill (see GSFloodFill::setLayout)
+		void setLayout(PFLayout_t l) { layout = l; }
+		void setThreads(int n) { nThreads = (n > 0)? n : 1; }
+		void setPhase(Phase* p) { phase = p; }		// NULL: no timing
+
+		// Whether band b was filled in tiles by GSParallelFloodFill
+		Boolean isTiled(size_t b) { return tiled[b] != 0; }
+		// Cells pushed onto Open and onto Pit for band b (by all its tiles, if it was tiled)
+		unsigned long getOpenPushes(size_t b) { return nOpenPushes[b]; }
+		unsigned long getPitPushes(size_t b) { return nPitPushes[b]; }
+		// Bytes allocated while filling band b (see GSFloodFill::getBytesAllocated)
+		unsigned long long getBytesAllocated(size_t b) { return nBytesAllocated[b]; }
+		// Statistics of the fill of band b (not kept if the band was tiled: all 0)
+		const GSFloodStats_t& getStats(size_t b) { return stats[b]; }
+
+	private:
+
+		int rows, cols, stride, pixStride;
+		int nThreads;
+		Phase* phase;
+		vector<T*> bands;
+		vector<int> done;		// not vector<bool>: bands are written concurrently
+		vector<int> tiled;
+		vector<unsigned long> nOpenPushes, nPitPushes;
+		vector<unsigned long long> nBytesAllocated;
+		vector<GSFloodStats_t> stats;
+
+		// One serial engine per band, and one tiled engine per tiled band, kept across calls
+		vector< std::unique_ptr< GSFloodFill<T, Connectivity> > > engines;
+		vector< std::unique_ptr< GSParallelFloodFill<T, Connectivity> > > tiledEngines;
+
+		void fillBand(size_t b, int threads);
+};
+
+template <typename T, int Connectivity>
+GSMultiBandFloodFill<T, Connectivity>::GSMultiBandFloodFill(int r, int c, int s, int ps) {
+	setSize(r, c, s, ps);
+	verbose = 0;
+	algorithm = PF_IMPROVED;
+	layout = PF_ROWS;
+	phase = NULL;
+	nThreads = std::max(1, (int) std::thread::hardware_concurrency());
+}
+
+template <typename T, int Connectivity>
+void GSMultiBandFloodFill<T, Connectivity>::setSize(int r, int c, int s, int ps) {
+	rows = r, cols = c;
+	pixStride = (ps > 0)? ps : 1;
+	stride = (s > 0)? s : c * pixStride;
+}
+
+//
+// Fills band b, on `threads' threads if the tiled priority-flood can be used
+//
+template <typename T, int Connectivity>
+void GSMultiBandFloodFill<T, Connectivity>::fillBand(size_t b, int threads) {
+	Phase::Scope scope(phase, phase? "fill band " + std::to_string(b) : std::string());
+
+	// the parallel priority-flood reproduces Algorithms 1 and 2, not the epsilon gradient; a
+	// band that fits in one tile would pay for the labels and the spill-over graph for nothing
+	if (threads > 1 && algorithm != PF_EPSILON && GSParallelFloodFill<T, Connectivity>::spansTiles(rows, cols)) {
+		if (tiledEngines[b] == NULL)		// each band has its own slot: no locking
+			tiledEngines[b].reset(new GSParallelFloodFill<T, Connectivity>());
+		GSParallelFloodFill<T, Connectivity>& floodFill = *tiledEngines[b];
+		floodFill.setDEM(bands[b], rows, cols, stride, pixStride);
+		floodFill.setVerbose(verbose);
+		floodFill.setThreads(threads);
+		floodFill.setAlgorithm(algorithm);
+		floodFill.setLayout(layout);
+		floodFill.setPhase(phase);
+		done[b] = floodFill.Transform();
+		tiled[b] = 1;
+		nOpenPushes[b] = floodFill.getOpenPushes();
+		nPitPushes[b] = floodFill.getPitPushes();
+		nBytesAllocated[b] = floodFill.getBytesAllocated();
+		return;
+	}
+
+	GSFloodFill<T, Connectivity>& floodFill = *engines[b];
+	floodFill.setDEM(bands[b], rows, cols, stride, pixStride);
+	floodFill.setVerbose(verbose);
+	floodFill.setAlgorithm(algorithm);
+	floodFill.setLayout(layout);
+	done[b] = floodFill.Transform(& stats[b]);
+	nOpenPushes[b] = floodFill.getOpenPushes();
+	nPitPushes[b] = floodFill.getPitPushes();
+	nBytesAllocated[b] = floodFill.getBytesAllocated();
+}
+
+//
+// Main function: fills all bands. Verbose runs fill one band at a time, to keep the trace readable.
+//
+template <typename T, int Connectivity>
+Boolean GSMultiBandFloodFill<T, Connectivity>::Transform() {
+	size_t n = bands.size();
+	int concurrent = verbose? 1 : (int) std::min((size_t) nThreads, n);
+	int perBand = std::max(1, nThreads / std::max(concurrent, 1));
+
+	done.assign(n, 0);
+	tiled.assign(n, 0);
+	nOpenPushes.assign(n, 0);
+	nPitPushes.assign(n, 0);
+	nBytesAllocated.assign(n, 0);
+	stats.assign(n, GSFloodStats_t());
+	while (engines.size() < n)
+		engines.push_back(std::unique_ptr< GSFloodFill<T, Connectivity> >(new GSFloodFill<T, Connectivity>()));
+	if (tiledEngines.size() < n)
+		tiledEngines.resize(n);
+
+	GSParallelFor(n, concurrent, [this, perBand](size_t b) { fillBand(b, perBand); });
+
+	return std::find(done.begin(), done.end(), 0) == done.end();
+}
+
+#endif /* __GSMultiBandFlood_H__ */
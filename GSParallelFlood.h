@@ -0,0 +1,329 @@
+/*************************************************************************************************
+ * Parallel Priority-Flood
+ *
+ * This code implements the tiled parallel priority-flood described in article:
+ * Barnes, R. "Parallel Priority-Flood Depression Filling for Trillion Cell Digital Elevation
+ * Models on Desktops or Clusters". Computers & Geosciences. Vol 96, Nov 2016, pp 56-68,
+ * doi: 10.1016/j.cageo.2016.07.001.
+ *
+ * The DEM is split into tiles, which worker threads fill independently with GSFloodFill,
+ * seeding each tile from its own perimeter and labelling the watershed of every perimeter cell.
+ * The labels form a spill-over graph: two labels are joined by the lowest elevation at which
+ * water crosses from one to the other, within a tile or across the edge between two tiles, and
+ * the labels that reach the edge of the DEM drain into the "ocean". A priority-flood of that
+ * graph from the ocean gives the water level of every label, and a last parallel pass raises
+ * each cell to the level of its label. The result is identical to GSFloodFill::Transform().
+ *
+ * Every worker thread fills its tiles with one GSFloodFill engine and one tile buffer, kept
+ * across tiles and across calls (see setDEM()), so that the tiles allocate nothing once the
+ * engines have grown to the size of a tile.
+ *
+ * With setPhase(), the three passes, and every tile within them, are timed as phases (see
+ * phase.h), so that a trace shows the idle time of each worker thread, on one track per thread
+ * of GSWorkerPool ("worker <n>", see GSParallelFor.h) for all the calls.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSParallelFlood_H__
+#define   __GSParallelFlood_H__
+
+#include <thread>
+#include <vector>
+#include <algorithm>	// std::max, std::min
+#include <memory>		// std::unique_ptr
+
+#include "GSAllocCounter.h"
+#include "GSSpillGraph.h"
+#include "GSParallelFor.h"
+#include "phase.h"
+
+using namespace std;
+
+// Default size of the tiles: DEMs of no more rows and columns are better filled serially
+#define GS_PARALLEL_TILE	1024
+
+template <typename T, int Connectivity = 8>
+class GSParallelFloodFill {
+	public:
+
+		GSParallelFloodFill(void);
+		GSParallelFloodFill(T* dem, int r, int c, int stride = 0, int pixStride = 1);
+		Boolean Transform(void);
+
+		// Binds the object to another DEM; the engines of the workers are reused
+		void setDEM(T* dem, int r, int c, int stride = 0, int pixStride = 1);
+
+		int verbose;
+		void setVerbose(int v) { verbose = v; }
+		void setThreads(int n) { nThreads = (n > 0)? n : 1; }
+		void setTileSize(int r, int c) { tileRows = r; tileCols = c; }
+		void setPhase(Phase* p) { phase = p; }		// NULL: no timing
+		// Of the tiles (see GSFloodFill); Algorithm 3 is not supported
+		PFAlgorithm_t algorithm;
+		void setAlgorithm(PFAlgorithm_t a) { algorithm = a; }
+		PFLayout_t layout;
+		void setLayout(PFLayout_t l) { layout = l; }
+
+		// Whether a DEM of r rows of c cells spans more than one tile of the default size
+		static Boolean spansTiles(int r, int c) { return r > GS_PARALLEL_TILE || c > GS_PARALLEL_TILE; }
+
+		// Cells pushed onto Open and onto Pit by the tiles of the last Transform(), in total, and
+		// heap bytes allocated by its tiles, its labels and its spill-over graph
+		unsigned long getOpenPushes(void) { return nOpenPushes; }
+		unsigned long getPitPushes(void) { return nPitPushes; }
+		unsigned long long getBytesAllocated(void) { return nBytesAllocated; }
+
+	private:
+
+		// Cell (i,j) is at(i,j), as in a strided view of GSFloodFill
+		T* dem;
+		int rows, cols, stride, pixStride;
+
+		T& at(int i, int j) { return dem[(ptrdiff_t) i * stride + (ptrdiff_t) j * pixStride]; }
+		int nThreads;
+		Phase* phase;
+		int tileRows, tileCols;
+		int nTileRows, nTileCols;
+		unsigned long nOpenPushes, nPitPushes;
+		unsigned long long nBytesAllocated;
+
+		typedef struct {
+			int r0, c0, rows, cols;
+			int32_t labelBase;					// global label = labelBase + tile label
+			vector< pair<uint64_t, T> > spill;	// spill-over edges between tile labels, sorted
+			unsigned long openPushes, pitPushes;
+			unsigned long long bytesAllocated;
+		} Tile_t;
+		vector<Tile_t> tiles;
+
+		// Tile label of every cell, turned into global labels once all tiles are filled
+		vector< int32_t, GSCountingAllocator<int32_t> > labels;
+
+		// The engine and the tile buffer of every worker
+		typedef struct {
+			std::unique_ptr< GSFloodFill<T, Connectivity> > floodFill;
+			vector< T, GSCountingAllocator<T> > buffer;
+		} Worker_t;
+		vector<Worker_t> workers;
+
+		int tileOf(int i, int j) { return (i / tileRows) * nTileCols + j / tileCols; }
+		void init(void);
+		void fillTile(Tile_t& t, Worker_t& w);
+		void mergeTiles(vector<T>& level);
+		void raiseTile(Tile_t& t, const vector<T>& level);
+};
+
+//
+// Constructor: strided view of a DEM of r rows of c cells; consecutive rows are `s' elements
+// apart (default: c * ps), consecutive cells of a row `ps' elements apart (default: 1)
+//
+template <typename T, int Connectivity>
+GSParallelFloodFill<T, Connectivity>::GSParallelFloodFill(T* dempar, int r, int c, int s, int ps) {
+	init();
+	setDEM(dempar, r, c, s, ps);
+}
+
+//
+// Constructor: no DEM yet, see setDEM()
+//
+template <typename T, int Connectivity>
+GSParallelFloodFill<T, Connectivity>::GSParallelFloodFill() {
+	init();
+	setDEM(NULL, 0, 0);
+}
+
+template <typename T, int Connectivity>
+void GSParallelFloodFill<T, Connectivity>::setDEM(T* dempar, int r, int c, int s, int ps) {
+	rows = r, cols = c;
+	pixStride = (ps > 0)? ps : 1;
+	stride = (s > 0)? s : c * pixStride;
+	dem = dempar;
+}
+
+template <typename T, int Connectivity>
+void GSParallelFloodFill<T, Connectivity>::init() {
+	verbose = 0;
+	nThreads = std::max(1, (int) std::thread::hardware_concurrency());
+	phase = NULL;
+	algorithm = PF_IMPROVED;
+	layout = PF_ROWS;
+	tileRows = tileCols = GS_PARALLEL_TILE;
+	nTileRows = nTileCols = 0;
+	nOpenPushes = nPitPushes = 0;
+	nBytesAllocated = 0;
+}
+
+//
+// First pass: fills a tile from its own perimeter and records its labels and spill-over edges
+//
+template <typename T, int Connectivity>
+void GSParallelFloodFill<T, Connectivity>::fillTile(Tile_t& t, Worker_t& w) {
+	Phase::Scope scope(phase, phase? "fill tile " + std::to_string(&t - &tiles[0]) : std::string());
+	GSAllocStats_t allocStart = GSAllocStats();		// per thread, as the worker
+	int i, j;
+
+	if (w.floodFill == NULL)
+		w.floodFill.reset(new GSFloodFill<T, Connectivity>());
+	GSFloodFill<T, Connectivity>& floodFill = *w.floodFill;
+	w.buffer.resize((size_t) t.rows * t.cols);
+	T* buffer = & w.buffer[0];
+
+	for (i=0; i<t.rows; i++)
+		for (j=0; j<t.cols; j++)
+			buffer[(size_t) i * t.cols + j] = at(t.r0 + i, t.c0 + j);
+
+	floodFill.setDEM(buffer, t.rows, t.cols);
+	floodFill.labelling = floodFill.spilling = floodFill.wholePerimeter = true;
+	floodFill.setAlgorithm(algorithm);
+	floodFill.setLayout(layout);
+	floodFill.Transform();
+
+	for (i=0; i<t.rows; i++)
+		for (j=0; j<t.cols; j++) {
+			at(t.r0 + i, t.c0 + j) = buffer[(size_t) i * t.cols + j];
+			labels[(size_t) (t.r0 + i) * cols + t.c0 + j] = floodFill.label(floodFill.cellAt(i, j));
+		}
+
+	t.labelBase = floodFill.nLabels;	// number of labels, until it is turned into a base
+	const typename GSSpillGraph<T>::Edges_t& spill = floodFill.Spill.sorted();
+	t.spill.assign(spill.begin(), spill.end());
+	t.openPushes = floodFill.getOpenPushes();
+	t.pitPushes = floodFill.getPitPushes();
+	t.bytesAllocated = GSAllocStats().bytes - allocStart.bytes;
+}
+
+//
+// Last pass: raises every cell of a tile to the water level of its label
+//
+template <typename T, int Connectivity>
+void GSParallelFloodFill<T, Connectivity>::raiseTile(Tile_t& t, const vector<T>& level) {
+	Phase::Scope scope(phase, phase? "raise tile " + std::to_string(&t - &tiles[0]) : std::string());
+	for (int i=0; i<t.rows; i++) {
+		const int32_t* lrow = & labels[(size_t) (t.r0 + i) * cols + t.c0];
+		for (int j=0; j<t.cols; j++) {
+			T& z = at(t.r0 + i, t.c0 + j);
+			z = std::max(z, level[t.labelBase + lrow[j]]);
+		}
+	}
+}
+
+
+//
+// Middle pass: the water level of every global label, from the spill-over graph of the tiles
+//
+template <typename T, int Connectivity>
+void GSParallelFloodFill<T, Connectivity>::mergeTiles(vector<T>& level) {
+	typedef GSNeighborhood<Connectivity> Nbh_t;
+	Phase::Scope scope(phase, "merge");
+	int i, j, k;
+	size_t t;
+
+	// Global labels: 0 is the ocean, the labels of tile t are labelBase+1 .. labelBase+nLabels
+	int32_t nLabels = 1;
+	for (t=0; t<tiles.size(); t++) {
+		int32_t n = tiles[t].labelBase;
+		tiles[t].labelBase = nLabels - 1;
+		nLabels += n;
+	}
+
+	// Spill-over graph: edges within the tiles...
+	GSSpillGraph<T> graph;
+	for (t=0; t<tiles.size(); t++) {
+		for (size_t e=0; e<tiles[t].spill.size(); e++)
+			graph.add(tiles[t].labelBase + GSSpillGraph<T>::first(tiles[t].spill[e]),
+				tiles[t].labelBase + GSSpillGraph<T>::second(tiles[t].spill[e]), tiles[t].spill[e].second);
+		vector< pair<uint64_t, T> >().swap(tiles[t].spill);
+	}
+
+	// ... across the edges between tiles, and from the edge of the DEM to the ocean
+	for (t=0; t<tiles.size(); t++) {
+		const Tile_t& tile = tiles[t];
+		for (i=tile.r0; i<tile.r0 + tile.rows; i++)
+			for (j=tile.c0; j<tile.c0 + tile.cols; j++) {
+				if (i != tile.r0 && i != tile.r0 + tile.rows - 1
+						&& j != tile.c0 && j != tile.c0 + tile.cols - 1) {
+					j = tile.c0 + tile.cols - 2;	// skip the interior of the tile
+					continue;
+				}
+
+				int32_t a = tile.labelBase + labels[(size_t) i * cols + j];
+				T za = at(i, j);
+
+				if (GSSpillGraph<T>::drainsToOcean(i, j, rows, cols))
+					graph.addOcean(a);
+
+				for (k=0; k<Nbh_t::n; k++) {
+					int ni = i + Nbh_t::di[k], nj = j + Nbh_t::dj[k];
+					if (ni < 0 || ni >= rows || nj < 0 || nj >= cols)
+						continue;
+					size_t nt = (size_t) tileOf(ni, nj);
+					if (nt <= t)	// each pair of tiles once
+						continue;
+					graph.add(a, tiles[nt].labelBase + labels[(size_t) ni * cols + nj], std::max(za, at(ni, nj)));
+				}
+			}
+	}
+
+	if (verbose)
+		std::cout << "Spill-over graph: " << nLabels << " labels, " << graph.sorted().size()
+			<< " edges." << std::endl;
+
+	// Priority-flood of the graph from the ocean: level[l] is the water level of label l
+	graph.solve(nLabels, level);
+}
+
+//
+// Main function (parallel flood-fill transform)
+//
+template <typename T, int Connectivity>
+Boolean GSParallelFloodFill<T, Connectivity>::Transform() {
+	int i, j;
+	size_t t;
+
+	if (rows <= 0 || cols <= 0)
+		return true;
+
+	// Split the DEM into tiles
+	nTileRows = (rows + tileRows - 1) / tileRows;
+	nTileCols = (cols + tileCols - 1) / tileCols;
+	tiles.resize((size_t) nTileRows * nTileCols);
+	for (i=0, t=0; i<nTileRows; i++)
+		for (j=0; j<nTileCols; j++, t++) {
+			tiles[t].r0 = i * tileRows;
+			tiles[t].c0 = j * tileCols;
+			tiles[t].rows = std::min(tileRows, rows - tiles[t].r0);
+			tiles[t].cols = std::min(tileCols, cols - tiles[t].c0);
+		}
+	GSAllocStats_t allocStart = GSAllocStats();
+	labels.resize((size_t) rows * cols);		// kept across calls
+	nBytesAllocated = GSAllocStats().bytes - allocStart.bytes;
+	workers.resize((size_t) std::max(1, std::min(nThreads, (int) tiles.size())));
+
+	if (verbose)
+		std::cout << "Filling " << tiles.size() << " tiles of " << tileRows << 'x' << tileCols
+			<< " cells with " << nThreads << " threads." << std::endl;
+
+	{
+		Phase::Scope scope(phase, "fill tiles");
+		GSParallelForWorkers(tiles.size(), nThreads, [this](size_t t, int w) { fillTile(tiles[t], workers[w]); });
+	}
+	nOpenPushes = nPitPushes = 0;
+	for (t=0; t<tiles.size(); t++) {
+		nOpenPushes += tiles[t].openPushes;
+		nPitPushes += tiles[t].pitPushes;
+		nBytesAllocated += tiles[t].bytesAllocated;
+	}
+
+	vector<T> level;
+	allocStart = GSAllocStats();
+	mergeTiles(level);
+	nBytesAllocated += GSAllocStats().bytes - allocStart.bytes;
+
+	Phase::Scope scope(phase, "raise tiles");
+	GSParallelFor(tiles.size(), nThreads, [this, &level](size_t t) { raiseTile(tiles[t], level); });
+
+	return true;
+}
+
+#endif /* __GSParallelFlood_H__ */
@@ -0,0 +1,91 @@
+/*************************************************************************************************
+ * GSParallelFloodFill benchmark
+ *
+ * Fills a synthetic DEM (rolling hills with random noise, so that it has depressions of every
+ * size) serially with GSFloodFill, then with GSParallelFloodFill on 1, 2, 4, ... threads up to
+ * the given maximum, checks that every parallel fill equals the serial one, and prints the best
+ * time of a few runs and the speedup over the serial fill for every thread count:
+ *
+ *     GSParallelFloodBench [rows [cols [max-threads [tile-size]]]]
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#include "GSPriorityFlood.h"
+
+#include <iostream>
+#include <iomanip>		// std::setw, std::setprecision
+#include <vector>
+#include <random>
+#include <cmath>		// std::sin, std::cos
+#include <cstdlib>		// atoi
+#include <chrono>		// std::chrono::steady_clock
+#include <thread>		// std::thread::hardware_concurrency
+
+typedef unsigned short Elevation_t;
+
+static const int runs = 3;
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+	int rows = (argc > 1)? atoi(argv[1]) : 4096;
+	int cols = (argc > 2)? atoi(argv[2]) : rows;
+	int maxThreads = (argc > 3)? atoi(argv[3]) : std::max(1, (int) std::thread::hardware_concurrency());
+	int tile = (argc > 4)? atoi(argv[4]) : 1024;
+	size_t n = (size_t) rows * cols;
+
+	if (rows <= 0 || cols <= 0 || maxThreads <= 0 || tile <= 0) {
+		std::cerr << "Usage: GSParallelFloodBench [rows [cols [max-threads [tile-size]]]]" << std::endl;
+		return -1;
+	}
+
+	vector<Elevation_t> dem(n), filled(n), work(n);
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> noise(0, 500);
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			dem[(size_t) i * cols + j] = (Elevation_t) (30000 + 20000 * std::sin(j * 0.01) * std::cos(i * 0.013)
+				+ noise(random));
+
+	// The serial fill is the reference, and the baseline of the speedups
+	double serial = 0;
+	for (int r=0; r<runs; r++) {
+		filled = dem;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GSFloodFill<Elevation_t> floodFill(& filled[0], rows, cols);
+		floodFill.Transform();
+		double s = seconds(start);
+		serial = r? std::min(serial, s) : s;
+	}
+
+	std::cout << rows << 'x' << cols << " cells of 16 bits, tiles of " << tile << 'x' << tile
+		<< ", best of " << runs << " runs" << std::endl;
+	std::cout << std::setw(8) << "threads" << std::setw(12) << "seconds" << std::setw(10) << "speedup" << std::endl;
+	std::cout << std::setw(8) << "serial" << std::fixed << std::setprecision(3) << std::setw(12) << serial
+		<< std::setw(10) << 1.0 << std::endl;
+
+	int failed = 0;
+	for (int t=1; t<=maxThreads; t = (t < maxThreads && 2 * t > maxThreads)? maxThreads : 2 * t) {
+		double best = 0;
+		for (int r=0; r<runs; r++) {
+			work = dem;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			GSParallelFloodFill<Elevation_t> floodFill(& work[0], rows, cols);
+			floodFill.setThreads(t);
+			floodFill.setTileSize(tile, tile);
+			floodFill.Transform();
+			double s = seconds(start);
+			best = r? std::min(best, s) : s;
+			if (work != filled)
+				failed++;
+		}
+		std::cout << std::setw(8) << t << std::setw(12) << best << std::setw(10) << serial / best << std::endl;
+	}
+
+	if (failed)
+		std::cerr << failed << " parallel fills differ from the serial fill!" << std::endl;
+	return failed? -1 : 0;
+}
@@ -0,0 +1,164 @@
+/*************************************************************************************************
+ * GSParallelFor
+ *
+ * Runs job(0) .. job(nJobs-1) on up to nThreads threads. Each thread takes the next job as soon
+ * as it is done with the previous one, so that jobs of unequal cost are balanced. The calling
+ * thread takes jobs too, and returns when all the jobs are complete.
+ *
+ * GSParallelForWorkers also passes the job the index of the worker that runs it, 0 .. nThreads-1
+ * (0 is the calling thread), so that the jobs can share per-worker scratch storage without
+ * locking.
+ *
+ * The other threads come from GSWorkerPool, which keeps them, idle, from call to call, instead
+ * of starting and joining new ones: a batch of images starts no more threads than its busiest
+ * call, and what the threads hold (such as the hardware counters of phase.h) is not opened again
+ * for every call. A call takes the idle threads it needs and starts new ones if there are not
+ * enough, so that calls from within jobs (nested calls) never wait for each other. The threads of
+ * the pool are numbered 1, 2, ... in the order they were started, for good (see Thread()), and
+ * name themselves "worker <n>" when they start, so that a trace (see phase.h) gives each of them
+ * one track under a stable name.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSParallelFor_H__
+#define   __GSParallelFor_H__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>		// std::unique_ptr
+#include <functional>
+#include <string>
+#include <algorithm>	// std::min
+
+#include "phase.h"
+
+class GSWorkerPool {
+	public:
+		// The pool of the process, joined at exit
+		static GSWorkerPool& Instance(void) {
+			static GSWorkerPool pool;
+			return pool;
+		}
+
+		// The number of the calling thread in the pool, or 0 if it is not a thread of the pool
+		static int Thread(void) { return Self(); }
+
+		// Runs task(1) .. task(n-1) on threads of the pool and task(0) on the calling thread,
+		// and returns when all are done
+		void run(int n, const std::function<void(int)>& task) {
+			Batch_t batch;
+			batch.pending = n - 1;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (int w = 1; w < n; w++) {
+					Slot_t* s;
+					if (idle.empty()) {
+						slots.push_back(std::unique_ptr<Slot_t>(new Slot_t()));
+						s = slots.back().get();
+						s->task = NULL;
+						s->number = (int) slots.size();
+						s->thread = std::thread(& GSWorkerPool::serve, this, s);
+					} else {
+						s = idle.back();
+						idle.pop_back();
+					}
+					s->task = & task;
+					s->worker = w;
+					s->batch = & batch;
+					s->wake.notify_one();
+				}
+			}
+
+			task(0);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			while (batch.pending > 0)
+				batch.done.wait(lock);
+		}
+
+		~GSWorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+				for (size_t k = 0; k < slots.size(); k++)
+					slots[k]->wake.notify_one();
+			}
+			for (size_t k = 0; k < slots.size(); k++)
+				slots[k]->thread.join();
+		}
+
+	private:
+		typedef struct {
+			int pending;						// tasks still running on pool threads
+			std::condition_variable done;
+		} Batch_t;
+
+		typedef struct {
+			std::thread thread;
+			std::condition_variable wake;
+			const std::function<void(int)>* task;	// NULL while the thread is idle
+			int number;							// see Thread()
+			int worker;
+			Batch_t* batch;
+		} Slot_t;
+
+		std::mutex mutex;						// guards all but the threads
+		std::vector< std::unique_ptr<Slot_t> > slots;
+		std::vector<Slot_t*> idle;
+		bool stopping;
+
+		GSWorkerPool() : stopping(false) { }
+		GSWorkerPool(const GSWorkerPool&) = delete;
+		GSWorkerPool& operator=(const GSWorkerPool&) = delete;
+
+		static int& Self(void) {
+			static thread_local int number = 0;
+			return number;
+		}
+
+		void serve(Slot_t* s) {
+			std::unique_lock<std::mutex> lock(mutex);
+			Self() = s->number;
+			Phase::SetDefaultThreadName("worker " + std::to_string(s->number), s->number);
+			for (;;) {
+				while (s->task == NULL && ! stopping)
+					s->wake.wait(lock);
+				if (s->task == NULL)
+					return;
+				const std::function<void(int)>* task = s->task;
+				lock.unlock();
+				(*task)(s->worker);
+				lock.lock();
+				s->task = NULL;
+				idle.push_back(s);
+				if (--s->batch->pending == 0)	// under the lock: the caller cannot return before
+					s->batch->done.notify_one();
+			}
+		}
+};
+
+inline void GSParallelForWorkers(size_t nJobs, int nThreads, std::function<void(size_t, int)> job) {
+	std::atomic<size_t> next(0);
+	int n = (int) std::min((size_t) std::max(nThreads, 1), nJobs);
+
+	if (n <= 1) {		// no need for threads
+		for (size_t j = 0; j < nJobs; j++)
+			job(j, 0);
+		return;
+	}
+
+	GSWorkerPool::Instance().run(n, [&](int w) {
+		for (size_t j = next++; j < nJobs; j = next++)
+			job(j, w);
+	});
+}
+
+inline void GSParallelFor(size_t nJobs, int nThreads, std::function<void(size_t)> job) {
+	GSParallelForWorkers(nJobs, nThreads, [&job](size_t j, int) { job(j); });
+}
+
+#endif /* __GSParallelFor_H__ */
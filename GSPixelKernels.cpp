@@ -0,0 +1,192 @@
+/*************************************************************************************************
+ * Pixel conversion kernels (see GSPixelKernels.h)
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#include "GSPixelKernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+//
+// Scalar versions
+//
+static void deinterleave3Scalar(const unsigned char *src, unsigned char *c0, unsigned char *c1,
+		unsigned char *c2, size_t n) {
+	for (size_t k = 0; k < n; k++, src += 3) {
+		c0[k] = src[0];
+		c1[k] = src[1];
+		c2[k] = src[2];
+	}
+}
+
+static void interleave3Scalar(const unsigned char *c0, const unsigned char *c1,
+		const unsigned char *c2, unsigned char *dst, size_t n) {
+	for (size_t k = 0; k < n; k++, dst += 3) {
+		dst[0] = c0[k];
+		dst[1] = c1[k];
+		dst[2] = c2[k];
+	}
+}
+
+static void subSatScalar(unsigned char *dst, const unsigned char *src, size_t n) {
+	for (size_t k = 0; k < n; k++)
+		dst[k] = (dst[k] > src[k])? dst[k] - src[k] : 0;
+}
+
+#ifdef GS_X86_KERNELS
+
+//
+// Shuffle masks for 16 pixels (48 bytes, three 16-byte chunks).
+// deint[ch][s]: picks from chunk s the bytes of channel ch, in pixel order;
+// inter[s][ch]: places the bytes of channel ch into chunk s.
+// A byte with the high bit set makes pshufb write zero.
+//
+struct ShuffleMasks {
+	unsigned char deint[3][3][16];
+	unsigned char inter[3][3][16];
+
+	ShuffleMasks() {
+		for (int ch = 0; ch < 3; ch++)
+			for (int s = 0; s < 3; s++)
+				for (int q = 0; q < 16; q++) {
+					int pos = 3 * q + ch;		// byte of pixel q, channel ch
+					deint[ch][s][q] = (pos >= 16 * s && pos < 16 * s + 16)? pos - 16 * s : 0x80;
+					int p = 16 * s + q;			// byte q of chunk s
+					inter[s][ch][q] = (p % 3 == ch)? p / 3 : 0x80;
+				}
+	}
+};
+static const ShuffleMasks masks;
+
+#define MASK(m) _mm_loadu_si128((const __m128i *) (m))
+
+__attribute__((target("ssse3")))
+static void deinterleave3SSSE3(const unsigned char *src, unsigned char *c0, unsigned char *c1,
+		unsigned char *c2, size_t n) {
+	unsigned char *c[3] = { c0, c1, c2 };
+	__m128i m[3][3];
+	size_t k = 0;
+	int ch, s;
+
+	for (ch = 0; ch < 3; ch++)
+		for (s = 0; s < 3; s++)
+			m[ch][s] = MASK(masks.deint[ch][s]);
+
+	for (; k + 16 <= n; k += 16, src += 48) {
+		__m128i a = _mm_loadu_si128((const __m128i *) src);
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 16));
+		__m128i d = _mm_loadu_si128((const __m128i *) (src + 32));
+		for (ch = 0; ch < 3; ch++)
+			_mm_storeu_si128((__m128i *) (c[ch] + k), _mm_or_si128(_mm_or_si128(
+				_mm_shuffle_epi8(a, m[ch][0]), _mm_shuffle_epi8(b, m[ch][1])),
+				_mm_shuffle_epi8(d, m[ch][2])));
+	}
+	deinterleave3Scalar(src, c0 + k, c1 + k, c2 + k, n - k);
+}
+
+__attribute__((target("ssse3")))
+static void interleave3SSSE3(const unsigned char *c0, const unsigned char *c1,
+		const unsigned char *c2, unsigned char *dst, size_t n) {
+	__m128i m[3][3];
+	size_t k = 0;
+	int ch, s;
+
+	for (s = 0; s < 3; s++)
+		for (ch = 0; ch < 3; ch++)
+			m[s][ch] = MASK(masks.inter[s][ch]);
+
+	for (; k + 16 <= n; k += 16, dst += 48) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (c0 + k));
+		__m128i y = _mm_loadu_si128((const __m128i *) (c1 + k));
+		__m128i z = _mm_loadu_si128((const __m128i *) (c2 + k));
+		for (s = 0; s < 3; s++)
+			_mm_storeu_si128((__m128i *) (dst + 16 * s), _mm_or_si128(_mm_or_si128(
+				_mm_shuffle_epi8(x, m[s][0]), _mm_shuffle_epi8(y, m[s][1])),
+				_mm_shuffle_epi8(z, m[s][2])));
+	}
+	interleave3Scalar(c0 + k, c1 + k, c2 + k, dst, n - k);
+}
+
+__attribute__((target("sse2")))
+static void subSatSSE2(unsigned char *dst, const unsigned char *src, size_t n) {
+	size_t k = 0;
+	for (; k + 16 <= n; k += 16)
+		_mm_storeu_si128((__m128i *) (dst + k), _mm_subs_epu8(
+			_mm_loadu_si128((const __m128i *) (dst + k)), _mm_loadu_si128((const __m128i *) (src + k))));
+	subSatScalar(dst + k, src + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void subSatAVX2(unsigned char *dst, const unsigned char *src, size_t n) {
+	size_t k = 0;
+	for (; k + 32 <= n; k += 32)
+		_mm256_storeu_si256((__m256i *) (dst + k), _mm256_subs_epu8(
+			_mm256_loadu_si256((const __m256i *) (dst + k)), _mm256_loadu_si256((const __m256i *) (src + k))));
+	subSatScalar(dst + k, src + k, n - k);
+}
+
+#endif /* GS_X86_KERNELS */
+
+//
+// Run-time selection
+//
+typedef void (*Deinterleave3_t)(const unsigned char *, unsigned char *, unsigned char *, unsigned char *, size_t);
+typedef void (*Interleave3_t)(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, size_t);
+typedef void (*SubSat_t)(unsigned char *, const unsigned char *, size_t);
+
+struct Kernels {
+	Deinterleave3_t deinterleave3;
+	Interleave3_t interleave3;
+	SubSat_t subSat;
+	const char *isa;
+
+	Kernels() {
+		deinterleave3 = deinterleave3Scalar;
+		interleave3 = interleave3Scalar;
+		subSat = subSatScalar;
+		isa = "scalar";
+#ifdef GS_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")) {
+			subSat = subSatSSE2;
+			isa = "SSE2";
+		}
+		if (__builtin_cpu_supports("ssse3")) {
+			deinterleave3 = deinterleave3SSSE3;
+			interleave3 = interleave3SSSE3;
+			isa = "SSSE3";
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			subSat = subSatAVX2;
+			isa = "AVX2";
+		}
+#endif
+	}
+};
+
+static const Kernels& kernels(void) {
+	static const Kernels k;		// initialized once, on first use
+	return k;
+}
+
+void GSDeinterleave3(const unsigned char *src, unsigned char *c0, unsigned char *c1,
+		unsigned char *c2, size_t n) {
+	kernels().deinterleave3(src, c0, c1, c2, n);
+}
+
+void GSInterleave3(const unsigned char *c0, const unsigned char *c1, const unsigned char *c2,
+		unsigned char *dst, size_t n) {
+	kernels().interleave3(c0, c1, c2, dst, n);
+}
+
+void GSSubSat(unsigned char *dst, const unsigned char *src, size_t n) {
+	kernels().subSat(dst, src, n);
+}
+
+const char *GSPixelKernelsISA(void) {
+	return kernels().isa;
+}
@@ -0,0 +1,32 @@
+/*************************************************************************************************
+ * Pixel conversion kernels
+ *
+ * Conversions between interleaved 3-channel pixels and planar channels, and the saturating
+ * difference of two images, for the places where planar buffers are still needed (e.g. the
+ * planar r, g, b buffers of ppmb_io). Each kernel has a scalar version and SIMD versions
+ * (SSSE3 for the shuffles, SSE2 and AVX2 for the difference); the best version supported by the
+ * CPU is selected at run time, the first time a kernel is called.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSPixelKernels_H__
+#define   __GSPixelKernels_H__
+
+#include <cstddef>		// size_t
+
+// c0[k] = src[3k], c1[k] = src[3k+1], c2[k] = src[3k+2], for k < n
+void GSDeinterleave3(const unsigned char *src, unsigned char *c0, unsigned char *c1,
+	unsigned char *c2, size_t n);
+
+// dst[3k] = c0[k], dst[3k+1] = c1[k], dst[3k+2] = c2[k], for k < n
+void GSInterleave3(const unsigned char *c0, const unsigned char *c1, const unsigned char *c2,
+	unsigned char *dst, size_t n);
+
+// dst[k] = max(dst[k] - src[k], 0), for k < n
+void GSSubSat(unsigned char *dst, const unsigned char *src, size_t n);
+
+// Name of the instruction set selected for the kernels ("scalar", "SSSE3", "AVX2", ...)
+const char *GSPixelKernelsISA(void);
+
+#endif /* __GSPixelKernels_H__ */
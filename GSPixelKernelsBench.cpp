@@ -0,0 +1,126 @@
+/*************************************************************************************************
+ * Pixel conversion kernels benchmark
+ *
+ * Times GSDeinterleave3, GSInterleave3 and GSSubSat (see GSPixelKernels.h) against the loops
+ * they replaced, which converted one pixel at a time through row pointers, on an image of the
+ * given size, and checks that both give the same bytes:
+ *
+ *     GSPixelKernelsBench [rows [cols]]
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#include "GSPixelKernels.h"
+
+#include <iostream>
+#include <iomanip>		// std::setw, std::setprecision
+#include <vector>
+#include <random>
+#include <cstdlib>		// atoi
+#include <chrono>		// std::chrono::steady_clock
+
+typedef bool Boolean;
+
+static const int runs = 5;
+
+// Best time of `runs' calls of f, in seconds
+template <typename F>
+static double best(F f) {
+	double t = 0;
+	for (int r=0; r<runs; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		t = r? std::min(t, s) : s;
+	}
+	return t;
+}
+
+static void report(const char *name, double loop, double kernel, Boolean same) {
+	std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(4)
+		<< std::setw(12) << loop << std::setw(12) << kernel << std::setprecision(2) << std::setw(9)
+		<< loop / kernel << (same? "" : "   DIFFERENT!") << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int rows = (argc > 1)? atoi(argv[1]) : 4000;
+	int cols = (argc > 2)? atoi(argv[2]) : 10000;
+	size_t n = (size_t) rows * cols;
+	int y, x;
+
+	if (rows <= 0 || cols <= 0) {
+		std::cerr << "Usage: GSPixelKernelsBench [rows [cols]]" << std::endl;
+		return -1;
+	}
+
+	std::vector<unsigned char> bgr(3 * n), out(3 * n), other(3 * n);
+	std::vector<unsigned char> planes(3 * n), ref(3 * n);
+	std::mt19937 random(1);
+	for (size_t k=0; k<bgr.size(); k++) {
+		bgr[k] = (unsigned char) random();
+		other[k] = (unsigned char) random();
+	}
+
+	// Row pointers of the planes, as the old loops had them
+	std::vector<unsigned char*> b(rows), g(rows), r(rows);
+	for (y=0; y<rows; y++) {
+		b[y] = & planes[(size_t) y * cols];
+		g[y] = & planes[n + (size_t) y * cols];
+		r[y] = & planes[2 * n + (size_t) y * cols];
+	}
+
+	std::cout << rows << 'x' << cols << " pixels, kernels: " << GSPixelKernelsISA() << ", best of " << runs
+		<< " runs" << std::endl;
+	std::cout << std::left << std::setw(14) << "" << std::right << std::setw(12) << "loop (s)"
+		<< std::setw(12) << "kernel (s)" << std::setw(9) << "speedup" << std::endl;
+
+	// Interleaved BGR => planar
+	double loop = best([&]() {
+		for (y=0; y<rows; y++)
+			for (x=0; x<cols; x++) {
+				const unsigned char *pixel = & bgr[3 * ((size_t) y * cols + x)];
+				b[y][x] = pixel[0];
+				g[y][x] = pixel[1];
+				r[y][x] = pixel[2];
+			}
+	});
+	ref = planes;
+	double kernel = best([&]() {
+		for (y=0; y<rows; y++)
+			GSDeinterleave3(& bgr[3 * (size_t) y * cols], b[y], g[y], r[y], cols);
+	});
+	report("deinterleave", loop, kernel, planes == ref);
+
+	// Planar => interleaved BGR
+	loop = best([&]() {
+		for (y=0; y<rows; y++)
+			for (x=0; x<cols; x++) {
+				unsigned char *pixel = & out[3 * ((size_t) y * cols + x)];
+				pixel[0] = b[y][x];
+				pixel[1] = g[y][x];
+				pixel[2] = r[y][x];
+			}
+	});
+	ref = out;
+	kernel = best([&]() {
+		for (y=0; y<rows; y++)
+			GSInterleave3(b[y], g[y], r[y], & out[3 * (size_t) y * cols], cols);
+	});
+	report("interleave", loop, kernel, out == ref);
+
+	// Saturating difference, on a copy of bgr each time
+	loop = best([&]() {
+		out = bgr;
+		for (size_t k=0; k<out.size(); k++)
+			out[k] = (out[k] > other[k])? out[k] - other[k] : 0;
+	});
+	ref = out;
+	kernel = best([&]() {
+		out = bgr;
+		for (y=0; y<rows; y++)
+			GSSubSat(& out[3 * (size_t) y * cols], & other[3 * (size_t) y * cols], 3 * (size_t) cols);
+	});
+	report("difference", loop, kernel, out == ref);
+
+	return 0;
+}
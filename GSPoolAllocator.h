@@ -0,0 +1,113 @@
+/*************************************************************************************************
+ * Node pool for the multimap priority queue
+ *
+ * std::multimap allocates one red-black tree node per queued cell and frees it when the cell is
+ * popped, so a priority-flood of a floating-point DEM calls malloc and free once per cell that
+ * goes through Open. GSNodePool hands out fixed-size blocks carved out of large chunks, and
+ * keeps the popped nodes on a free list for the next pushes: the chunks are only allocated while
+ * the queue grows past its largest size so far, and are freed with the pool. A reused
+ * GSFloodFill therefore stops allocating once its queue has reached its peak size.
+ *
+ * The first chunk holds `reserve(n)' blocks (GSFloodFill reserves the number of edge cells,
+ * which are all on Open at the start), and every further chunk is twice as large as the last.
+ *
+ * GSPoolAllocator is the std::allocator interface to a GSNodePool, for the multimap of
+ * GSMapPrioQueue (see GSPrioQueue.h).
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSPoolAllocator_H__
+#define   __GSPoolAllocator_H__
+
+#include <cstddef>		// size_t
+#include <new>			// operator new
+#include <vector>
+#include <algorithm>	// std::max
+
+#include "GSAllocCounter.h"
+
+class GSNodePool {
+	public:
+		GSNodePool() : blockSize(0), nextChunk(1024), freeList(NULL) { }
+		~GSNodePool() {
+			for (size_t k=0; k<chunks.size(); k++)
+				::operator delete(chunks[k]);
+		}
+
+		// At least n blocks in the next chunk
+		void reserve(size_t n) { if (n > nextChunk) nextChunk = n; }
+
+		// bytes with the given alignment (at most that of std::max_align_t)
+		void* allocate(size_t bytes, size_t align) {
+			if (blockSize == 0) {	// the size of the nodes is known at their first allocation
+				if (align < alignof(Block_t)) align = alignof(Block_t);
+				blockSize = (std::max(bytes, sizeof(Block_t)) + align - 1) / align * align;
+			}
+			if (bytes > blockSize) {	// arrays and other sizes are not pooled
+				GSCountAllocation(bytes);
+				return ::operator new(bytes);
+			}
+			if (freeList == NULL)
+				grow();
+			Block_t* b = freeList;
+			freeList = b->next;
+			return b;
+		}
+		void deallocate(void* p, size_t bytes) {
+			if (bytes > blockSize) {
+				::operator delete(p);
+				return;
+			}
+			Block_t* b = static_cast<Block_t*>(p);
+			b->next = freeList;
+			freeList = b;
+		}
+
+		GSNodePool(const GSNodePool&) = delete;
+		GSNodePool& operator=(const GSNodePool&) = delete;
+
+	private:
+		typedef struct Block { struct Block* next; } Block_t;
+
+		size_t blockSize;			// bytes per block, a multiple of the alignment of the nodes
+		size_t nextChunk;			// blocks in the next chunk
+		Block_t* freeList;
+		std::vector<void*> chunks;
+
+		void grow(void) {
+			char* chunk = static_cast<char*>(::operator new(nextChunk * blockSize));
+			GSCountAllocation(nextChunk * blockSize);
+			chunks.push_back(chunk);
+			for (size_t k = nextChunk; k-- > 0; ) {
+				Block_t* b = reinterpret_cast<Block_t*>(chunk + k * blockSize);
+				b->next = freeList;
+				freeList = b;
+			}
+			nextChunk *= 2;
+		}
+};
+
+//
+// std::allocator that takes its memory from a GSNodePool
+//
+template <typename T>
+class GSPoolAllocator {
+	public:
+		typedef T value_type;
+
+		explicit GSPoolAllocator(GSNodePool* p) : pool(p) { }
+		template <typename U> GSPoolAllocator(const GSPoolAllocator<U>& a) : pool(a.pool) { }
+
+		T* allocate(size_t n) { return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T))); }
+		void deallocate(T* p, size_t n) { pool->deallocate(p, n * sizeof(T)); }
+
+		GSNodePool* pool;
+};
+
+template <typename T, typename U>
+inline bool operator==(const GSPoolAllocator<T>& a, const GSPoolAllocator<U>& b) { return a.pool == b.pool; }
+template <typename T, typename U>
+inline bool operator!=(const GSPoolAllocator<T>& a, const GSPoolAllocator<U>& b) { return a.pool != b.pool; }
+
+#endif /* __GSPoolAllocator_H__ */
@@ -0,0 +1,334 @@
+/*************************************************************************************************
+ * Priority queues for the Priority-Flood Algorithm
+ *
+ * The Open queue of the priority-flood only ever needs three operations: push a cell with a
+ * given elevation, pop the cell with the lowest elevation, and test for emptiness.
+ *
+ * GSMapPrioQueue is the general implementation, based on std::multimap (O(log n) per operation).
+ * Its allocator is a template parameter; the default takes the tree nodes from a GSNodePool
+ * (see GSPoolAllocator.h), which recycles them instead of calling malloc and free per cell.
+ * GSBucketPrioQueue is used for integral elevations of at most 16 bits: it keeps one FIFO
+ * bucket per possible elevation (256 or 65536 buckets), so that push and pop are O(1) and the
+ * whole fill becomes linear in the number of cells.
+ *
+ * GSRadixPrioQueue is used for float and double elevations. The priority-flood (but for the
+ * epsilon variant, see below) never pushes a cell below the last popped elevation, which is the
+ * monotone property that a radix heap needs:
+ * elevations are mapped to unsigned integers with the same order, and each element is kept in
+ * the bucket of the highest bit in which its key differs from the last popped key, so that push
+ * is O(1) and every element moves down at most once per bit (O(log range) amortized per pop).
+ *
+ * GSPrioQueueSelector<T,E>::type selects the best queue for elevation type T at compile time.
+ *
+ * GSFifo is the plain queue Pit. Unlike std::queue, whose deque frees its blocks as they are
+ * drained, it keeps its storage when it empties, so a reused engine stops allocating.
+ *
+ * All queues allocate through GSCountingAllocator (see GSAllocCounter.h).
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSPrioQueue_H__
+#define   __GSPrioQueue_H__
+
+#include <map>
+#include <vector>
+#include <limits>		// std::numeric_limits
+#include <cstddef>		// size_t
+#include <type_traits>	// std::is_integral
+#include <functional>	// std::less
+#include <cstdint>		// uint32_t, uint64_t
+#include <cstring>		// memcpy
+
+#include "GSAllocCounter.h"
+#include "GSPoolAllocator.h"
+
+using namespace std;
+
+typedef bool Boolean;
+
+//
+// Allocators of the multimap queue: pool allocators are bound to the pool of their queue,
+// other allocators are default-constructed
+//
+template <typename Alloc>
+struct GSAllocatorFor {
+	static Alloc make(GSNodePool*) { return Alloc(); }
+};
+
+template <typename U>
+struct GSAllocatorFor< GSPoolAllocator<U> > {
+	static GSPoolAllocator<U> make(GSNodePool* pool) { return GSPoolAllocator<U>(pool); }
+};
+
+//
+// Priority queue based on std::multimap: any elevation type, O(log n) per operation
+//
+template <typename T, typename E, typename Alloc = GSPoolAllocator< pair<const T, E> > >
+class GSMapPrioQueue {
+	public:
+		typedef std::multimap<T, E, std::less<T>, Alloc> Map_t;
+		typedef typename Map_t::iterator MapIterator_t;
+
+		GSMapPrioQueue() : q(std::less<T>(), GSAllocatorFor<Alloc>::make(&pool)) { }
+
+		void push(T prio, const E& e) { q.insert(pair<T,E>(prio, e)); }
+		Boolean pop(E& e) {
+			if (q.empty()) return false;
+			MapIterator_t it = q.begin();
+			e = it->second;
+			q.erase(it);
+			return true;
+		}
+		T topPriority(void) const { return q.begin()->first; }
+		Boolean empty(void) const { return q.empty(); }
+		size_t size(void) const { return q.size(); }
+		void clear(void) { q.clear(); }
+		void reserve(size_t n) { pool.reserve(n); }	// n elements are expected at once
+
+	private:
+		GSNodePool pool;	// declared first: it must outlive q
+		Map_t q;
+};
+
+//
+// Bucket priority queue: one FIFO bucket per elevation, for integral types of <= 16 bits
+//
+template <typename T, typename E>
+class GSBucketPrioQueue {
+	public:
+		static const size_t nBuckets = size_t(1) << (8 * sizeof(T));
+
+		GSBucketPrioQueue() : buckets(nBuckets), heads(nBuckets, 0), cur(nBuckets), n(0) { }
+
+		void push(T prio, const E& e) {
+			size_t k = key(prio);
+			buckets[k].push_back(e);
+			if (k < cur) cur = k;
+			n++;
+		}
+		Boolean pop(E& e) {
+			if (n == 0) return false;
+			// skip the drained buckets; elevations are popped in non-decreasing order
+			while (heads[cur] == buckets[cur].size()) {
+				buckets[cur].clear();	// keeps the capacity for later pushes
+				heads[cur] = 0;
+				cur++;
+			}
+			e = buckets[cur][ heads[cur]++ ];
+			if (--n == 0) {		// no later pop walks past this bucket: drain it now
+				buckets[cur].clear();
+				heads[cur] = 0;
+			}
+			return true;
+		}
+		T topPriority(void) {
+			while (heads[cur] == buckets[cur].size()) {
+				buckets[cur].clear();
+				heads[cur] = 0;
+				cur++;
+			}
+			return prio(cur);
+		}
+		Boolean empty(void) const { return n == 0; }
+		size_t size(void) const { return n; }
+		void reserve(size_t) { }
+		void clear(void) {
+			for (size_t k=0; k<nBuckets; k++) {
+				buckets[k].clear();
+				heads[k] = 0;
+			}
+			cur = nBuckets;
+			n = 0;
+		}
+
+	private:
+		typedef vector< E, GSCountingAllocator<E> > Bucket_t;
+		vector< Bucket_t, GSCountingAllocator<Bucket_t> > buckets;
+		vector< size_t, GSCountingAllocator<size_t> > heads;	// index of the first unpopped element of each bucket
+		size_t cur;				// lowest bucket that may still be non-empty
+		size_t n;				// number of queued elements
+
+		static size_t key(T prio) {
+			return (size_t) ((long) prio - (long) std::numeric_limits<T>::min());
+		}
+		static T prio(size_t k) {
+			return (T) ((long) k + (long) std::numeric_limits<T>::min());
+		}
+};
+
+//
+// Order-preserving keys of floating-point elevations: unsigned integers that compare as the
+// elevations do. Positive elevations get the sign bit set, negative ones have all their bits
+// flipped (so -9999 < -1 < 0 < 1); -0 is mapped to +0, which it equals.
+//
+template <typename T, typename K>
+struct GSFloatKey {
+	static const K signBit = K(1) << (8 * sizeof(K) - 1);
+
+	static K key(T v) {
+		K u;
+		if (v == 0) v = 0;
+		memcpy(& u, & v, sizeof(u));
+		return (u & signBit)? ~u : (u | signBit);
+	}
+	static T value(K k) {
+		K u = (k & signBit)? (k & ~signBit) : ~k;
+		T v;
+		memcpy(& v, & u, sizeof(v));
+		return v;
+	}
+};
+
+template <typename T> struct GSFloatKeyOf;
+template <> struct GSFloatKeyOf<float>  { typedef GSFloatKey<float, uint32_t> type; typedef uint32_t Key_t; };
+template <> struct GSFloatKeyOf<double> { typedef GSFloatKey<double, uint64_t> type; typedef uint64_t Key_t; };
+
+//
+// Radix heap (monotone priority queue) for float and double elevations. Bucket 0 holds the
+// elements equal to the last popped key; bucket b > 0 those whose key differs from it first at
+// bit b-1. Equal elevations always share a bucket and are popped in the order in which they
+// were pushed, as with GSMapPrioQueue.
+// Algorithms 1 and 2 never push below the last popped elevation. Algorithm 3 can, when it pops
+// Open while Pit still holds raised cells: the queue then starts again from the pushed key,
+// redistributing all its elements (O(n), but rare).
+//
+template <typename T, typename E>
+class GSRadixPrioQueue {
+	public:
+		typedef typename GSFloatKeyOf<T>::Key_t Key_t;
+		typedef typename GSFloatKeyOf<T>::type FloatKey_t;
+		static const int nBuckets = 8 * sizeof(Key_t) + 1;
+
+		GSRadixPrioQueue() : buckets(nBuckets), head(0), last(0), n(0) { }
+
+		void push(T prio, const E& e) {
+			Key_t k = FloatKey_t::key(prio);
+			if (k < last)
+				rebase(k);
+			buckets[bucketOf(k)].push_back(Item_t(k, e));
+			n++;
+		}
+		Boolean pop(E& e) {
+			if (n == 0) return false;
+			refill();
+			e = buckets[0][head++].second;
+			if (--n == 0) {		// any priority can be pushed again
+				buckets[0].clear();
+				head = 0;
+				last = 0;
+			}
+			return true;
+		}
+		T topPriority(void) {
+			refill();
+			return FloatKey_t::value(last);
+		}
+		Boolean empty(void) const { return n == 0; }
+		size_t size(void) const { return n; }
+		void reserve(size_t) { }
+		void clear(void) {
+			for (int b=0; b<nBuckets; b++)
+				buckets[b].clear();	// keeps the capacity for later pushes
+			head = 0;
+			last = 0;
+			n = 0;
+		}
+
+	private:
+		typedef pair<Key_t, E> Item_t;
+		typedef vector< Item_t, GSCountingAllocator<Item_t> > Bucket_t;
+		vector< Bucket_t, GSCountingAllocator<Bucket_t> > buckets;
+		size_t head;		// first unpopped element of bucket 0
+		Key_t last;			// last popped key
+		size_t n;			// number of queued elements
+		Bucket_t spare;		// scratch of rebase()
+
+		static int highestBit(uint32_t x) { return 31 - __builtin_clz(x); }
+		static int highestBit(uint64_t x) { return 63 - __builtin_clzll(x); }
+		int bucketOf(Key_t k) const { return (k == last)? 0 : highestBit(k ^ last) + 1; }
+
+		// Makes bucket 0 non-empty (n > 0): the lowest non-empty bucket is redistributed around
+		// its minimum, which becomes the last popped key; its elements all land in lower buckets
+		void refill(void) {
+			if (head < buckets[0].size())
+				return;
+			buckets[0].clear();
+			head = 0;
+
+			int b = 1;
+			while (buckets[b].empty())
+				b++;
+			Bucket_t& from = buckets[b];
+			last = from[0].first;
+			for (size_t k=1; k<from.size(); k++)
+				if (from[k].first < last)
+					last = from[k].first;
+			for (size_t k=0; k<from.size(); k++)
+				buckets[bucketOf(from[k].first)].push_back(from[k]);
+			from.clear();
+		}
+
+		// Makes k the last popped key, with k below the current one
+		void rebase(Key_t k) {
+			spare.assign(buckets[0].begin() + head, buckets[0].end());
+			buckets[0].clear();
+			head = 0;
+			for (int b=1; b<nBuckets; b++) {
+				spare.insert(spare.end(), buckets[b].begin(), buckets[b].end());
+				buckets[b].clear();
+			}
+			last = k;
+			for (size_t i=0; i<spare.size(); i++)
+				buckets[bucketOf(spare[i].first)].push_back(spare[i]);
+			spare.clear();
+		}
+};
+
+//
+// FIFO queue that keeps its storage: a vector and the index of its first unpopped element. The
+// vector is emptied (not freed) whenever the queue drains, which Pit does before each pop of Open.
+//
+template <typename E>
+class GSFifo {
+	public:
+		GSFifo() : head(0) { }
+
+		void push(const E& e) { q.push_back(e); }
+		const E& front(void) const { return q[head]; }
+		void pop(void) {
+			if (++head == q.size()) {
+				q.clear();
+				head = 0;
+			}
+		}
+		Boolean empty(void) const { return head == q.size(); }
+		size_t size(void) const { return q.size() - head; }
+		void clear(void) { q.clear(); head = 0; }
+
+	private:
+		vector< E, GSCountingAllocator<E> > q;
+		size_t head;
+};
+
+//
+// Compile-time selection of the queue implementation
+//
+template <typename T, typename E,
+	bool Bucketed = std::is_integral<T>::value && sizeof(T) <= 2,
+	bool Radix = std::is_same<T, float>::value || std::is_same<T, double>::value>
+struct GSPrioQueueSelector {
+	typedef GSMapPrioQueue<T, E> type;
+};
+
+template <typename T, typename E>
+struct GSPrioQueueSelector<T, E, true, false> {
+	typedef GSBucketPrioQueue<T, E> type;
+};
+
+template <typename T, typename E>
+struct GSPrioQueueSelector<T, E, false, true> {
+	typedef GSRadixPrioQueue<T, E> type;
+};
+
+#endif /* __GSPrioQueue_H__ */
@@ -23,6 +23,11 @@
 #include <vector>
 #include <algorithm>	// std::max
 #include <queue>
+#include <cmath>		// std::nextafter
+#include <type_traits>	// std::is_floating_point
+#include <cstdint>		// uint32_t
+#include <cstddef>		// ptrdiff_t
+#include <chrono>		// std::chrono::steady_clock, for GSFloodStats_t
 
 using namespace std;
 
@@ -30,7 +35,18 @@ typedef double Real;
 typedef bool Boolean;
 typedef pair<int,int> XY_t;
 typedef queue<XY_t> Q_t;
+typedef uint32_t Cell_t;			// linear index of a DEM cell, i * stride + j
 
+#include "GSPrioQueue.h"
+
+typedef GSFifo<Cell_t> CellQ_t;	// keeps its storage across fills (see GSPrioQueue.h)
+
+#include "GSClosedMask.h"
+#include "GSSpillGraph.h"
+#include "GSTrace.h"
 #include "GSPriorityFloodClass.cpp"
+#include "GSParallelFlood.h"
+#include "GSStreamFlood.h"
+#include "GSMultiBandFlood.h"
 
 #endif /* __PRIOFLOOD_H__ */
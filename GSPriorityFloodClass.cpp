@@ -19,141 +19,313 @@ typedef bool Boolean;
 
 using namespace std;
 
+//
+// Variants of the priority-flood, numbered as in the article
+//
+typedef enum {
+	PF_ORIGINAL = 1,	// Algorithm 1: every cell goes through the priority queue Open
+	PF_IMPROVED = 2,	// Algorithm 2: depression cells go through the plain queue Pit
+	PF_EPSILON  = 3		// Algorithm 3: as 2, but depressions are filled with an epsilon gradient
+} PFAlgorithm_t;
+
+//
+// Statistics of one Transform(), for sizing the queues and the pools and for spotting inputs
+// that make the fill slow (see GSFloodFill::Transform)
+//
+typedef struct {
+	unsigned long edges;			// edge cells, seeded onto Open
+	unsigned long openPushes;		// cells pushed onto Open, the edges included
+	unsigned long pitPushes;		// cells pushed onto Pit
+	unsigned long raised;			// cells whose elevation the fill has raised
+	size_t peakOpen, peakPit;		// largest number of cells on Open and on Pit
+	double seedSeconds;				// clearing Closed and seeding Open with the edges
+	double drainSeconds;			// draining Open and Pit
+} GSFloodStats_t;
+
+//
+// Memory layouts of the cells during Transform()
+//
+typedef enum {
+	PF_ROWS  = 1,		// the DEM as it is, row after row
+	PF_TILED = 2		// a copy of the DEM in tiles of GS_TILE x GS_TILE cells, tile after tile
+} PFLayout_t;
+
+//
+// Side of the tiles of PF_TILED, a power of two: 64 x 64 cells are 4 KiB of uint8 elevations
+// and 512 bytes of Closed bits
+//
+#define GS_TILE_SHIFT	6
+#define GS_TILE			(1 << GS_TILE_SHIFT)
+
+//
+// Smallest value larger than v (floating-point T); integral T have no epsilon
+//
+template <typename T, bool Floating = std::is_floating_point<T>::value>
+struct GSNextUp {
+	static T of(T v) { return v; }
+};
+
 template <typename T>
+struct GSNextUp<T, true> {
+	static T of(T v) { return std::nextafter(v, std::numeric_limits<T>::infinity()); }
+};
+
+//
+// Neighborhoods: (di, dj) offsets of the 4 or 8 neighbors of a cell
+//
+template <int Connectivity, typename Dummy = void>
+struct GSNeighborhood;
+
+template <typename Dummy>
+struct GSNeighborhood<4, Dummy> {
+	// . X .
+	// X . X
+	// . X .
+	static constexpr int n = 4;
+	static constexpr int di[4] = { -1,  0, 0, 1 };
+	static constexpr int dj[4] = {  0, -1, 1, 0 };
+};
+template <typename Dummy> constexpr int GSNeighborhood<4, Dummy>::di[4];
+template <typename Dummy> constexpr int GSNeighborhood<4, Dummy>::dj[4];
+
+template <typename Dummy>
+struct GSNeighborhood<8, Dummy> {
+	// X X X
+	// X . X
+	// X X X
+	static constexpr int n = 8;
+	static constexpr int di[8] = { -1, -1, -1,  0, 0,  1, 1, 1 };
+	static constexpr int dj[8] = { -1,  0,  1, -1, 1, -1, 0, 1 };
+};
+template <typename Dummy> constexpr int GSNeighborhood<8, Dummy>::di[8];
+template <typename Dummy> constexpr int GSNeighborhood<8, Dummy>::dj[8];
+
+//
+// D8 flow direction codes, as in ESRI rasters: 1 = east, 2 = south-east, 4 = south,
+// 8 = south-west, 16 = west, 32 = north-west, 64 = north, 128 = north-east, 0 = none
+//
+inline uint8_t GSD8Code(int di, int dj) {
+	static const uint8_t code[9] = { 32, 64, 128, 16, 0, 1, 8, 4, 2 };
+	return code[(di + 1) * 3 + (dj + 1)];
+}
+
+template <typename T, int Connectivity> class GSParallelFloodFill;
+template <typename T, int Connectivity> class GSStreamFloodFill;
+
+//
+// The Open queue is a template parameter, by default the best queue for T (see GSPrioQueue.h);
+// e.g. GSFloodFill< float, 8, GSMapPrioQueue< float, Cell_t, std::allocator< pair<const float,
+// Cell_t> > > > allocates every node of its multimap with malloc.
+// So is the tracing of every cell (see GSTrace.h): GSNoTrace compiles it away, and e.g.
+// GSFloodFill< float, 8, GSPrioQueueSelector<float, Cell_t>::type, GSRingTrace > records it.
+//
+template <typename T, int Connectivity = 8,
+	typename PrioQ = typename GSPrioQueueSelector<T, Cell_t>::type, typename Trace = GSNoTrace>
 class GSFloodFill {
+	friend class GSParallelFloodFill<T, Connectivity>;
+	friend class GSStreamFloodFill<T, Connectivity>;
+
 	public:
 
-		GSFloodFill(T** dem, int r, int c);
+		GSFloodFill(void);
+		GSFloodFill(T* dem, int r, int c, int stride = 0, int pixStride = 1);
+		GSFloodFill(T** dem, int r, int c);	// adapter for row-pointer DEMs
 		~GSFloodFill(void); // throw();
-		Boolean Transform(void);
-
-
-		typedef std::multimap<T, XY_t> PrioQ_t;
-		typedef typename PrioQ_t::iterator PrIterator_t;
+		// Returns false if the DEM cannot be filled. If stats is not NULL, it receives the
+		// statistics of the fill, which are counted in local variables of the fill loop.
+		Boolean Transform(GSFloodStats_t* stats = NULL);
+
+		// Binds the object to another DEM; its Closed mask and queues are reused
+		void setDEM(T* dem, int r, int c, int stride = 0, int pixStride = 1);
+
+		// Watershed labeling (Algorithm 4): fills the DEM as Transform() does and, in the same
+		// pass, writes the watershed of every cell into labels, r rows of c labels, consecutive
+		// rows labelStride apart (default: c). Every edge cell starts a watershed, which the
+		// cells it floods inherit; the labels are 1 .. getLabelCount().
+		Boolean Label(int32_t* labels, int labelStride = 0, GSFloodStats_t* stats = NULL);
+		int32_t getLabelCount(void) { return nLabels; }
+
+		// D8 flow directions: when dirs is not NULL, Transform() and Label() also write into
+		// dirs (r rows of c codes, consecutive rows dirStride apart, default: c) the direction
+		// of every cell toward the neighbor it was reached from (see GSD8Code), as they close it.
+		// Edge cells drain out of the DEM and get 0.
+		void setFlowDirections(uint8_t* dirs, int dirStride = 0) { flowDir = dirs; flowStride = dirStride; }
+
+		// With PF_TILED, Transform() and Label() copy the DEM into tiles of GS_TILE x GS_TILE
+		// cells and fill the copy, which they copy back at the end. The priority-flood visits
+		// the cells in elevation order, which jumps across the rows of a large DEM; in tiles,
+		// the neighbors of a cell share its pages and cache lines, except along the tile edges.
+		PFLayout_t layout;
+		void setLayout(PFLayout_t l) { layout = l; }
+
+
+		// Bucket queue for integral T of <= 16 bits, pooled multimap otherwise (see GSPrioQueue.h)
+		typedef PrioQ PrioQ_t;
+
+		// verbose prints a summary of every Transform(); the trace of every cell goes to trace
 		int verbose;
 		void setVerbose(int v) { verbose = v; }
+		PFAlgorithm_t algorithm;
+		void setAlgorithm(PFAlgorithm_t a) { algorithm = a; }
+
+		// Number of cells pushed onto Open and onto Pit by the last Transform()
+		unsigned long getOpenPushes(void) { return nOpenPushes; }
+		unsigned long getPitPushes(void) { return nPitPushes; }
+
+		// Heap bytes and blocks allocated by the last Transform(). An engine that is reused on
+		// inputs of the same size or smaller keeps its storage, and allocates nothing.
+		unsigned long long getBytesAllocated(void) { return nBytesAllocated; }
+		unsigned long long getAllocations(void) { return nAllocations; }
+
+		// The events of the cells, recorded during Transform() if Trace::enabled
+		Trace& getTrace(void) { return trace; }
 
 	private:
 
-		T** dem;
-		Boolean **Closed;
-		int rows, cols;
+		// The DEM is a strided buffer: cell c = i*stride + j is at(c) = dem[c * pixStride]
+		T* dem;
+		int rows, cols, stride, pixStride;
+
+		T& at(Cell_t c) { return dem[(size_t) c * pixStride]; }
+
+		// One bit per cell, with a sentinel border of closed cells (see GSClosedMask.h)
+		GSClosedMask Closed;
+
+		// Layouts that cell indices cannot address (row-pointer DEMs whose rows are not evenly
+		// spaced, row strides that are not a multiple of the pixel stride) are copied into
+		// rowCopy by Transform() and copied back at the end
+		T** rowDem;
+		T* extDem;
+		ptrdiff_t extStride, extPixStride;
+		vector< T, GSCountingAllocator<T> > rowCopy;
+		void init(void);
+		void useCopy(void);
+		void copyIn(void);
+		void copyOut(void);
 
 		// Let Open be a priority queue
 		PrioQ_t Open;
 
 		// Let Pit be a plain queue
-		Q_t Pit;
-
-		Boolean isWithin(XY_t xy);
-		Boolean PrioPopHighest(PrioQ_t& queue, XY_t& xy);
-		Boolean PrioPop(PrioQ_t& queue, XY_t& xy);
-		Boolean isClosed(XY_t xy);
-		Boolean neighborsOf(XY_t xy, vector<XY_t>& v);
-		XY_t miNeighbors(vector<XY_t> neighbors);
-		//template <typename T>
-		void printHelp(void);
-};
+		CellQ_t Pit;
 
-template <typename T>
-Boolean GSFloodFill<T>::PrioPopHighest(PrioQ_t& queue, XY_t& xy) {
-	if (queue.size() == 0) return false;
-	PrIterator_t it = queue.end();
-	it--;
-	xy = it->second;
-	queue.erase(it);
-	return true;
-}
+		unsigned long nOpenPushes, nPitPushes;
+		unsigned long long nBytesAllocated, nAllocations;
 
-template <typename T>
-Boolean GSFloodFill<T>::PrioPop(PrioQ_t& queue, XY_t& xy) {
-	if (queue.size() == 0) return false;
-	PrIterator_t it = queue.begin();
-	xy = it->second;
-	queue.erase(it);
-	return true;
-}
+		Trace trace;
+		void traceEvent(GSTraceEvent_t e, Cell_t c, T z) {
+			if (Trace::enabled)
+				trace.event(e, rowOf(c), colOf(c), (double) z);
+		}
 
-template <typename T>
-inline Boolean GSFloodFill<T>::isWithin(XY_t xy) {
-	if (xy.first < 0 || xy.first >= rows)	return false;
-	if (xy.second < 0 || xy.second >= cols)	return false;
-	return true;
-}
+		// Watershed labels (Algorithm 4), for Label() and for the tiles of GSParallelFloodFill
+		// and GSStreamFloodFill. When labelling is set, every edge cell gets its own label, which
+		// the cells it floods inherit; Labels is laid out as Closed, so that the label of any
+		// neighbor can be read. When spilling is also set, Spill joins each pair of adjacent
+		// labels at the lowest elevation at which water crosses from one to the other (see
+		// GSSpillGraph.h).
+		// wholePerimeter seeds every edge cell even of a single-row DEM, as tiles need.
+		Boolean labelling, spilling, wholePerimeter;
+		vector< int32_t, GSCountingAllocator<int32_t> > Labels;
+		int32_t nLabels;
+		GSSpillGraph<T> Spill;
+
+		int32_t& label(Cell_t c) { return Labels[(Cell_t) (c + labelOrigin)]; }
+		Cell_t labelOrigin;
+
+		// Flow directions: flowOut[c] is the code of cell c, in flowDir itself if its rows are
+		// `stride' codes apart (and the layout is PF_ROWS), in flowCopy otherwise, which
+		// Transform() copies into flowDir
+		uint8_t* flowDir;
+		int flowStride;
+		uint8_t* flowOut;
+		vector< uint8_t, GSCountingAllocator<uint8_t> > flowCopy;
+
+		// offset[k] is the distance, in the DEM buffer, between a cell and its k-th neighbor,
+		// and flowCode[k] the direction from that neighbor back to the cell
+		typedef GSNeighborhood<Connectivity> Nbh_t;
+		int offset[Nbh_t::n];
+		uint8_t flowCode[Nbh_t::n];
+
+		// PF_TILED: the cell of row i and column j is cell (i+1, j+1) of a grid of tileRows x
+		// tileCols tiles, whose first row and column and whose cells beyond the DEM are closed
+		// sentinels. tileCopy holds the elevations, and dem points to it during the fill.
+		// Within a tile, the neighbors of a cell are at the same offsets as in a DEM of
+		// GS_TILE columns; along the tile edges they are found from the coordinates.
+		Boolean tiled;
+		int tileRows, tileCols;
+		vector< T, GSCountingAllocator<T> > tileCopy;
+		Cell_t tileCell(int I, int J) {
+			return ((Cell_t) ((I >> GS_TILE_SHIFT) * tileCols + (J >> GS_TILE_SHIFT)) << (2 * GS_TILE_SHIFT))
+				| ((Cell_t) (I & (GS_TILE - 1)) << GS_TILE_SHIFT) | (Cell_t) (J & (GS_TILE - 1));
+		}
+		void tileIn(void);
+		void tileOut(void);
 
-template <typename T>
-inline Boolean GSFloodFill<T>::isClosed(XY_t xy) {
-	return Closed[xy.first][xy.second];
-}
+		// Cell of row i and column j, and the neighbors of cell c
+		Cell_t cellAt(int i, int j) { return tiled? tileCell(i + 1, j + 1) : (Cell_t) i * stride + j; }
+		void neighbors(Cell_t c, Cell_t* nb);
 
-template <typename T>
-Boolean GSFloodFill<T>::neighborsOf(XY_t xy, vector<XY_t>& v) {
-	if (!isWithin(xy)) return false;
-	
-	XY_t tXY;
-
-	v.clear();
-	
-	
-	// X 0 0
-	// X . 0
-	// X 0 0
-
-	// 0 0 X
-	// 0 . X
-	// 0 0 X
-	for (int i = -1; i<=1; i++) {
-		tXY.first = xy.first + i;
-		tXY.second = xy.second - 1;
-		if (isWithin(tXY)) {
-			v.push_back(tXY);
+		int rowOf(Cell_t c) {
+			if (! tiled) return c / stride;
+			return (int) ((c >> (2 * GS_TILE_SHIFT)) / tileCols << GS_TILE_SHIFT | ((c >> GS_TILE_SHIFT) & (GS_TILE - 1))) - 1;
 		}
-		
-		tXY.second = xy.second + 1;
-		if (isWithin(tXY)) {
-			v.push_back(tXY);
+		int colOf(Cell_t c) {
+			if (! tiled) return c % stride;
+			return (int) ((c >> (2 * GS_TILE_SHIFT)) % tileCols << GS_TILE_SHIFT | (c & (GS_TILE - 1))) - 1;
 		}
-	}
-
-	// 0 X 0
-	// 0 . 0
-	// 0 X 0
-	tXY.first = xy.first - 1;
-	tXY.second = xy.second;
-	if (isWithin(tXY)) {
-		v.push_back(tXY);
-	}
-	tXY.first = xy.first + 1;
-	if (isWithin(tXY)) {
-		v.push_back(tXY);
-	}
+		void seed(Cell_t c);
+		Boolean isWithin(int i, int j);
+		Boolean isNeighborOf(Cell_t c, int k);
+		//template <typename T, int Connectivity>
+		void printHelp(void);
+};
 
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+inline Boolean GSFloodFill<T, Connectivity, PrioQ, Trace>::isWithin(int i, int j) {
+	if (i < 0 || i >= rows)	return false;
+	if (j < 0 || j >= cols)	return false;
 	return true;
 }
 
-template <typename T>
-XY_t GSFloodFill<T>::miNeighbors(vector<XY_t> neighbors) {
-	Real mindem = std::numeric_limits<T>::max();
-	XY_t minxy = pair<int,int>(-1,-1);
-	
-	for (vector<XY_t>::iterator it = neighbors.begin(); it != neighbors.end(); it++) {
-		if (dem[it->first][it->second] < mindem) {
-			mindem = dem[it->first][it->second];
-			minxy = *it;
+// c + offset[k] is the k-th neighbor of c within the DEM (not a sentinel, nor a wrapped cell)
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+inline Boolean GSFloodFill<T, Connectivity, PrioQ, Trace>::isNeighborOf(Cell_t c, int k) {
+	return isWithin(rowOf(c) + Nbh_t::di[k], colOf(c) + Nbh_t::dj[k]);
+}
+
+// Pushes edge cell c onto Open, unless it is already there
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+inline void GSFloodFill<T, Connectivity, PrioQ, Trace>::seed(Cell_t c) {
+	if (Closed.isClosed(c)) return;
+	Open.push(at(c), c);
+	Closed.close(c);
+	if (flowOut != NULL)
+		flowOut[c] = 0;
+}
+
+// nb[k] is the k-th neighbor of c, or a closed sentinel
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+inline void GSFloodFill<T, Connectivity, PrioQ, Trace>::neighbors(Cell_t c, Cell_t* nb) {
+	if (tiled) {
+		int I = (int) (c >> GS_TILE_SHIFT) & (GS_TILE - 1), J = (int) c & (GS_TILE - 1);
+		if (I == 0 || I == GS_TILE - 1 || J == 0 || J == GS_TILE - 1) {	// along the tile edges
+			I = rowOf(c) + 1, J = colOf(c) + 1;
+			for (int k = 0; k < Nbh_t::n; k++)
+				nb[k] = tileCell(I + Nbh_t::di[k], J + Nbh_t::dj[k]);
+			return;
 		}
 	}
-	return minxy;
+	for (int k = 0; k < Nbh_t::n; k++)
+		nb[k] = c + offset[k];
 }
 
 //
 // Destructor
 //
-template <typename T>
-GSFloodFill<T>::~GSFloodFill() {
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+GSFloodFill<T, Connectivity, PrioQ, Trace>::~GSFloodFill() {
 	try {
-		for (int i=0; i<rows; i++)
-			delete Closed[i];
-		delete Closed;
 		Open.clear();
 		//Pit.clear();
 	} catch (std::exception& e) {
@@ -162,166 +334,411 @@ GSFloodFill<T>::~GSFloodFill() {
 	}
 }
 
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::init() {
+	dem = NULL;
+	rows = cols = 0;
+	stride = 0;
+	rowDem = NULL;
+	extDem = NULL;
+	extStride = extPixStride = 0;
+	pixStride = 1;
+	verbose = 0;
+	algorithm = PF_IMPROVED;
+	nOpenPushes = nPitPushes = 0;
+	nBytesAllocated = nAllocations = 0;
+	labelling = spilling = wholePerimeter = false;
+	nLabels = 0;
+	flowDir = flowOut = NULL;
+	flowStride = 0;
+	layout = PF_ROWS;
+	tiled = false;
+	tileRows = tileCols = 0;
+	labelOrigin = 0;
+}
+
 //
-// Constructor
+// Constructor: no DEM yet, see setDEM()
 //
-template <typename T>
-GSFloodFill<T>::GSFloodFill(T** dempar, int r, int c) {
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+GSFloodFill<T, Connectivity, PrioQ, Trace>::GSFloodFill() {
+	init();
+}
+
+//
+// Constructor: strided view of a DEM, see setDEM()
+//
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+GSFloodFill<T, Connectivity, PrioQ, Trace>::GSFloodFill(T* dempar, int r, int c, int s, int ps) {
+	init();
+	setDEM(dempar, r, c, s, ps);
+}
+
+//
+// Strided view of a DEM of r rows of c cells. Consecutive rows are `s' elements apart
+// (default: c * ps), consecutive cells of a row `ps' elements apart (default: 1). With ps > 1
+// the view addresses one channel of an interleaved image, which is filled in place.
+//
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::setDEM(T* dempar, int r, int c, int s, int ps) {
 	rows = r, cols = c;
+	if (ps < 1) ps = 1;
+	if (s <= 0) s = c * ps;
 	dem = dempar;
-	verbose = 0;
+	pixStride = ps;
+	stride = s / ps;
+	rowDem = NULL;
+	extDem = NULL;
+	rowCopy.clear();
+
+	if (s % ps != 0 || stride < cols) {
+		extDem = dempar;
+		extStride = s, extPixStride = ps;
+		useCopy();
+	}
+}
+
+//
+// Constructor: DEM as an array of r row pointers. Evenly spaced rows (the usual case of
+// rows carved out of one buffer) are used in place; otherwise the DEM is copied into a
+// contiguous buffer, which Transform() copies back at the end.
+//
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+GSFloodFill<T, Connectivity, PrioQ, Trace>::GSFloodFill(T** dempar, int r, int c) {
+	init();
+	rows = r, cols = c;
+
+	ptrdiff_t s = (rows > 1)? dempar[1] - dempar[0] : cols;
+	Boolean evenlySpaced = (s >= cols);
+	for (int i=2; i<rows && evenlySpaced; i++)
+		evenlySpaced = (dempar[i] - dempar[i-1] == s);
+
+	if (evenlySpaced) {
+		dem = dempar[0];
+		stride = (int) s;
+	} else {
+		rowDem = dempar;
+		useCopy();
+	}
+}
+
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::useCopy() {
+	rowCopy.resize((size_t) rows * cols);
+	dem = & rowCopy[0];
+	stride = cols;
+	pixStride = 1;
+}
+
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::copyIn() {
+	for (int i=0; i<rows; i++) {
+		T* row = dem + (size_t) i * stride;
+		if (rowDem != NULL)
+			std::copy(rowDem[i], rowDem[i] + cols, row);
+		else
+			for (int j=0; j<cols; j++)
+				row[j] = extDem[i * extStride + j * extPixStride];
+	}
+}
+
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::copyOut() {
+	for (int i=0; i<rows; i++) {
+		T* row = dem + (size_t) i * stride;
+		if (rowDem != NULL)
+			std::copy(row, row + cols, rowDem[i]);
+		else
+			for (int j=0; j<cols; j++)
+				extDem[i * extStride + j * extPixStride] = row[j];
+	}
+}
+
+
+// The DEM, in row layout at dem, into the tiles of tileCopy
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::tileIn() {
+	tileCopy.resize((size_t) tileRows * tileCols << (2 * GS_TILE_SHIFT));
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			tileCopy[tileCell(i + 1, j + 1)] = dem[((size_t) i * stride + j) * pixStride];
+}
+
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+void GSFloodFill<T, Connectivity, PrioQ, Trace>::tileOut() {
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			dem[((size_t) i * stride + j) * pixStride] = tileCopy[tileCell(i + 1, j + 1)];
 }
 
 
 //
 // Main function (Flood-fill transform)
 //
-template <typename T>
-Boolean GSFloodFill<T>::Transform() {
-	int i, j;
-	XY_t xy, c;
-	PrIterator_t it;
-	vector<XY_t> neighbors;
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+Boolean GSFloodFill<T, Connectivity, PrioQ, Trace>::Transform(GSFloodStats_t* stats) {
+	int i, j, k;
+	Cell_t c = 0;
+	Boolean hasPitTop = false;
+	T PitTop = T();
+	Cell_t nb[Nbh_t::n];
+
+	if (rows <= 0 || cols <= 0)
+		return true;
+
+	GSAllocStats_t allocStart = GSAllocStats();
+
+	// PF_TILED: the DEM and its sentinel border, in whole tiles; the tiles are the rows of a
+	// DEM of GS_TILE columns, whose row step is the one of the neighbor offsets within a tile
+	tiled = (layout == PF_TILED);
+	tileRows = (rows + 2 + GS_TILE - 1) >> GS_TILE_SHIFT;
+	tileCols = (cols + 2 + GS_TILE - 1) >> GS_TILE_SHIFT;
+	int gridRows = tiled? tileRows * tileCols * GS_TILE : rows;
+	int gridStride = tiled? GS_TILE : stride;
+
+	if (GSClosedMask::nBits(gridRows, gridStride) > std::numeric_limits<Cell_t>::max()) {
+		std::cerr << "GSFloodFill: a DEM of " << rows << 'x' << stride
+			<< " cells cannot be addressed with 32-bit cell indices." << std::endl;
+		return false;
+	}
+
+	if (! rowCopy.empty())
+		copyIn();
+
+	T* rowLayoutDem = dem;
+	int rowLayoutPixStride = pixStride;
+	if (tiled) {
+		tileIn();
+		dem = & tileCopy[0];
+		pixStride = 1;
+	}
+
+	 ////////////////////////////////////////////////// 
+	// Algorithm 1, 2 or 3, according to `algorithm' //
+	 //////////////////////////////////////////////////
 
-	 /////////////// 
-	// Algorithm 2 //
-	 ///////////////
+	std::chrono::steady_clock::time_point seedStart;
+	if (stats != NULL)
+		seedStart = std::chrono::steady_clock::now();
 
 	// Let Closed have the same dimensions as DEM
 	// Let Closed be initialized to false
-	Closed = new Boolean* [rows];
-	for (i=0; i<rows; i++) {
-		Closed[i] = new Boolean [cols];
-		for (j=0; j<cols; j++) {
-			Closed[i][j] = false;
+	Closed.reset(gridRows, tiled? GS_TILE : cols, gridStride);
+	if (tiled) {	// the sentinel border and the cells beyond the DEM
+		int I, J, gridCols = tileCols * GS_TILE;
+		gridRows = tileRows * GS_TILE;
+		for (I=0; I<gridRows; I++) {
+			Closed.close(tileCell(I, 0));
+			for (J=cols+1; J<gridCols; J++)
+				Closed.close(tileCell(I, J));
+		}
+		for (J=1; J<=cols; J++) {
+			Closed.close(tileCell(0, J));
+			for (I=rows+1; I<gridRows; I++)
+				Closed.close(tileCell(I, J));
 		}
 	}
 
-	if (rows == 1) { // monodimensional case
-		xy = pair<int,int>(0, 0);
-		Open.insert(pair<T,XY_t>(dem[0][0], xy));
-		Closed[0][0] = true;
-		xy = pair<int,int>(0, cols-1);
-		Open.insert(pair<T,XY_t>(dem[0][cols-1], xy));
-		Closed[0][cols-1] = true;
+	for (k = 0; k < Nbh_t::n; k++) {
+		offset[k] = Nbh_t::di[k] * gridStride + Nbh_t::dj[k];
+		flowCode[k] = GSD8Code(-Nbh_t::di[k], -Nbh_t::dj[k]);
+	}
+
+	flowOut = NULL;
+	if (flowDir != NULL) {
+		if (! tiled && (flowStride > 0? flowStride : cols) == stride)
+			flowOut = flowDir;
+		else {
+			flowCopy.resize(tiled? tileCopy.size() : (size_t) rows * stride);
+			flowOut = & flowCopy[0];
+		}
+	}
+
+	if (labelling) {
+		Labels.assign(tiled? tileCopy.size() : (size_t) GSClosedMask::nBits(rows, stride), 0);
+		labelOrigin = tiled? 0 : stride + 1;
+		nLabels = 0;
+		Spill.clear();
+	}
+
+	// All the edge cells are on Open at the start
+	Open.reserve((rows > 1)? 2 * ((size_t) rows + cols) : (size_t) cols);
+
+	if (rows == 1 && ! wholePerimeter) { // monodimensional case
+		seed(cellAt(0, 0));
+		seed(cellAt(0, cols-1));
 	} else {		// bidimensional case
 		// for all edges of DEM do
 		for (j=0; j<cols; j++) {
-			xy = pair<int,int>(0, j);
-			Open.insert(pair<T,XY_t>(dem[0][j], xy));
-			Closed[0][j] = true;
-			xy = pair<int,int>(rows-1, j);
-			Open.insert(pair<T,XY_t>(dem[rows-1][j], xy));
-			Closed[rows-1][j] = true;
+			seed(cellAt(0, j));
+			seed(cellAt(rows-1, j));
 		}
 		for (i=1; i<rows-1; i++) {
-			xy = pair<int,int>(i, 0);
-			Open.insert(pair<T,XY_t>(dem[i][0], xy));
-			Closed[i][0] = true;
-			xy = pair<int,int>(i,cols-1);
-			Open.insert(pair<T,XY_t>(dem[i][cols-1], xy));
-			Closed[i][cols-1] = true;
+			seed(cellAt(i, 0));
+			seed(cellAt(i, cols-1));
 		}
 	}
 
-	if (verbose) {
-		std::cout << "Number of edges: " << Open.size() << std::endl;
-		for (it=Open.begin(), i=1; it != Open.end(); it++, i++)
-				std::cout << "Edge " << i << ": (" << it->first << ") => (" << it->second.first
-					<< ", " << it->second.second << ")\n";
-	}
+	// Counters of the fill, kept in registers rather than in members, which the stores into
+	// the DEM could alias
+	unsigned long edges = Open.size(), openPushes = edges, pitPushes = 0, nRaised = 0;
+	size_t peakOpen = 0, peakPit = 0;
 
+	if (verbose)
+		std::cout << "Number of edges: " << edges << std::endl;
 
+	std::chrono::steady_clock::time_point drainStart;
+	if (stats != NULL)
+		drainStart = std::chrono::steady_clock::now();
 
 	// while either Open or Pit is not empty do
 	while ( ! Open.empty() || ! Pit.empty() ) {
-		if ( ! Pit.empty() ) {
+		// the queues only grow between pops
+		peakOpen = std::max(peakOpen, Open.size());
+		peakPit = std::max(peakPit, Pit.size());
+
+		if ( ! Pit.empty() && algorithm == PF_EPSILON && ! Open.empty()
+				&& Open.topPriority() <= at(Pit.front()) ) {
+			// a cell on Open is not higher than the raised pit cells
+			Open.pop(c);
+			hasPitTop = false;
+		} else if ( ! Pit.empty() ) {
 			c=Pit.front();
 			Pit.pop();
+			if (! hasPitTop) {
+				PitTop = at(c);
+				hasPitTop = true;
+			}
 		} else {
-			PrioPop(Open,c);
-		}
-
-		// An edge was found on either Open or Pit
-		if (verbose)
-			std::cerr << "Processing cell (" << c.first << ',' << c.second << "), elevation= " << (Real) dem[c.first][c.second]  << std::endl;
-		
-		if (! isWithin(c)) {
-			if (verbose)
-				std::cerr << "\tIgnoring the cell, as it is not within the DEM." << std::endl;
-			continue;
-		}
-
-		// The edge is within the DEM
-		if (verbose)
-			std::cerr << "\tCell is within the DEM." << std::endl;
-
-		// neighbors lists the neighbors of c
-		if (! neighborsOf(c, neighbors)) {
-			if (verbose)
-				std::cerr << "\tCell has no neighbors." << std::endl;
-			continue;
+			Open.pop(c);
+			hasPitTop = false;
 		}
-		// Here, neighbors contains the neighbors of c
-		if (verbose)
-			std::cerr << "\tCell has " << neighbors.size() << " neighbors." << std::endl;
-		
 
-		// miNeighbor is the coordinates of the cell with minimal elevation
-		XY_t miNeighbor = miNeighbors(neighbors);
-		if (verbose)
-			std::cerr << "\tNeighbor with minimal elevation is (" << miNeighbor.first << ',' << miNeighbor.second
-				 << "), whose elevation is " << dem[miNeighbor.first][miNeighbor.second] << "." << std::endl;
-
-		
-		if (verbose)
-			std::cerr << "\tFor all neighbors, do:" << std::endl;
+		// Edge cells start a new watershed
+		if (labelling && label(c) == 0)
+			label(c) = ++nLabels;
 
+		// An edge was found on either Open or Pit
+		traceEvent(hasPitTop? GS_TRACE_POP_PIT : GS_TRACE_POP_OPEN, c, at(c));
 
+		// The neighbors of c are c + offset[k]; those outside the DEM fall on the
+		// sentinels of Closed, which are always closed, so no cell needs a bounds check
+		neighbors(c, nb);
+		for (k = 0; k < Nbh_t::n; k++) {
+			Cell_t n = nb[k];
 
-		for (vector<XY_t>::iterator nit = neighbors.begin(); nit != neighbors.end(); nit++) {
-			XY_t n = *nit;
+			if (Closed.isClosed(n)) {
+				if (Trace::enabled && isNeighborOf(c, k))
+					traceEvent(GS_TRACE_CLOSED, n, at(n));
 
-			if (isClosed(n)) {
-				if (verbose)
-					std::cerr << "\t\tNeighbor (" << n.first << ',' << n.second << ") has been already "
-					<< "encountered -- ignoring it." << std::endl;
+				// Both elevations are final: n was closed before c was popped
+				if (spilling && label(n) != 0 && label(n) != label(c) && isNeighborOf(c, k))
+					Spill.add(label(c), label(n), std::max(at(c), at(n)));
 
 				continue;
 			}
 
-			if (verbose) {
-				std::cerr << "\t\tProcessing neighbor (" << n.first << ',' << n.second << "):" << std::endl;
-
-				std::cerr << "\t\t\tCalculating max(current neighbor, popped cell), i.e. max(dem[" 
-					<< n.first << "][" << n.second << "], dem[" << c.first << "][" << c.second << "]) = "
-					<< "max(" << dem[n.first][n.second] << ", " << dem[c.first][c.second] << ") = "
-					<< std::max(dem[n.first][n.second], dem[c.first][c.second]) << std::endl;
-
-				std::cerr << "\t\t\tElevating cell (" << n.first << ',' << n.second << ") from " << dem[n.first][n.second]
-					<< " to " << std::max(dem[n.first][n.second], dem[c.first][c.second]) << std::endl;
+			Closed.close(n);
+			if (labelling)
+				label(n) = label(c);
+			if (flowOut != NULL)
+				flowOut[n] = flowCode[k];
+
+			if (algorithm == PF_ORIGINAL) {
+				// Push n onto Open with priority max(DEM(n), DEM(c))
+				if (at(n) < at(c)) {
+					traceEvent(GS_TRACE_RAISE, n, at(n));
+					nRaised++;
+				}
+				at(n) = std::max(at(n), at(c));
+				traceEvent(GS_TRACE_PUSH_OPEN, n, at(n));
+
+				Open.push(at(n), n);
+				openPushes++;
+				continue;
 			}
 
-			Closed[n.first][n.second] = true;
+			// With PF_EPSILON, depressions are raised to the next representable elevation
+			T raised = (algorithm == PF_EPSILON)? GSNextUp<T>::of(at(c)) : at(c);
 
-			if (dem[n.first][n.second] <= dem[c.first][c.second]) {
-				dem[n.first][n.second] = dem[c.first][c.second];
+			if (at(n) <= raised) {
+				if (Trace::enabled && algorithm == PF_EPSILON && hasPitTop && PitTop < at(n))
+					traceEvent(GS_TRACE_EPSILON, n, at(n));
+				if (at(n) < raised) {
+					traceEvent(GS_TRACE_RAISE, n, at(n));
+					nRaised++;
+				}
 
-				if (verbose)
-					std::cerr << "\t\t\tPush cell (" << n.first << ',' << n.second << ") onto queue Pit" << std::endl;
+				at(n) = raised;
+				traceEvent(GS_TRACE_PUSH_PIT, n, at(n));
 
 				Pit.push(n);
+				pitPushes++;
 			} else {
-				if (verbose)
-					std::cerr << "\t\t\tPush cell (" << n.first << ',' << n.second << ") onto stack Open with priority "
-						<< dem[n.first][n.second] << std::endl;
+				traceEvent(GS_TRACE_PUSH_OPEN, n, at(n));
 
 				// Push n onto Open with priority DEM(n)
-				Open.insert(pair<Real,XY_t>(dem[nit->first][nit->second], *nit));
+				Open.push(at(n), n);
+				openPushes++;
 			}
 		}
 	}
 
+	nOpenPushes = openPushes;
+	nPitPushes = pitPushes;
+	if (stats != NULL) {
+		std::chrono::steady_clock::time_point drainEnd = std::chrono::steady_clock::now();
+		stats->edges = edges;
+		stats->openPushes = openPushes;
+		stats->pitPushes = pitPushes;
+		stats->raised = nRaised;
+		stats->peakOpen = peakOpen;
+		stats->peakPit = peakPit;
+		stats->seedSeconds = std::chrono::duration<double>(drainStart - seedStart).count();
+		stats->drainSeconds = std::chrono::duration<double>(drainEnd - drainStart).count();
+	}
+
+	if (verbose)
+		std::cout << "Cells pushed onto Open: " << nOpenPushes << ", onto Pit: " << nPitPushes << std::endl;
+
+	if (tiled) {
+		dem = rowLayoutDem;
+		pixStride = rowLayoutPixStride;
+		tileOut();
+	}
+
+	if (! rowCopy.empty())
+		copyOut();
+
+	if (flowOut != NULL && flowOut != flowDir)
+		for (i=0; i<rows; i++)
+			for (j=0; j<cols; j++)
+				flowDir[(size_t) i * (flowStride > 0? flowStride : cols) + j] = flowOut[cellAt(i, j)];
+
+	nBytesAllocated = GSAllocStats().bytes - allocStart.bytes;
+	nAllocations = GSAllocStats().count - allocStart.count;
+	if (verbose)
+		std::cout << "Bytes allocated: " << nBytesAllocated << " in " << nAllocations << " blocks" << std::endl;
+
+	return true;
+}
+//
+// Watershed labeling (Algorithm 4), see the declaration
+//
+template <typename T, int Connectivity, typename PrioQ, typename Trace>
+Boolean GSFloodFill<T, Connectivity, PrioQ, Trace>::Label(int32_t* labels, int labelStride, GSFloodStats_t* stats) {
+	if (labelStride <= 0)
+		labelStride = cols;
+
+	labelling = true;
+	Boolean ok = Transform(stats);
+	labelling = false;
+	if (! ok)
+		return false;
+
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			labels[(size_t) i * labelStride + j] = label(cellAt(i, j));
 	return true;
 }
 #endif
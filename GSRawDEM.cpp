@@ -0,0 +1,175 @@
+/*************************************************************************************************
+ * Raw DEM files (see GSRawDEM.h)
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#include "GSRawDEM.h"
+
+#include <iostream>
+#include <cstring>		// memcmp, memcpy, strerror
+#include <cerrno>		// errno
+#include <fcntl.h>		// open
+#include <unistd.h>		// read, close, ftruncate
+#include <sys/mman.h>	// mmap, msync, munmap
+#include <sys/stat.h>	// fstat
+
+static const char magic[8] = { 'G', 'S', 'D', 'E', 'M', 0, 0, 1 };
+static const uint32_t byteOrderMark = 0x01020304;
+static const size_t headerSize = 64;
+
+typedef struct {
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t type;
+	uint64_t rows, cols, stride, offset;
+	uint64_t reserved[2];
+} Header_t;
+
+GSRawDEM::GSRawDEM() {
+	fd = -1;
+	base = NULL;
+	length = 0;
+	cellType = GS_RAW_U8;
+	nRows = nCols = 0;
+	rowStride = 0;
+	offset = 0;
+}
+
+GSRawDEM::~GSRawDEM() {
+	close();
+}
+
+size_t GSRawDEM::cellSize(GSRawType_t t) {
+	switch (t) {
+	case GS_RAW_U8:  return 1;
+	case GS_RAW_I16:
+	case GS_RAW_U16: return 2;
+	case GS_RAW_I32:
+	case GS_RAW_F32: return 4;
+	case GS_RAW_F64: return 8;
+	}
+	return 0;
+}
+
+Boolean GSRawDEM::isRaw(const std::string& p) {
+	char m[sizeof(magic)];
+	int f = ::open(p.c_str(), O_RDONLY);
+	if (f < 0)
+		return false;
+	Boolean raw = (::read(f, m, sizeof(m)) == (ssize_t) sizeof(m)) && memcmp(m, magic, sizeof(m)) == 0;
+	::close(f);
+	return raw;
+}
+
+Boolean GSRawDEM::open(const std::string& p, Boolean writable) {
+	Header_t h;
+
+	close();
+	path = p;
+	fd = ::open(p.c_str(), writable? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "GSRawDEM: cannot open " << p << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	if (::read(fd, & h, sizeof(h)) != (ssize_t) sizeof(h) || memcmp(h.magic, magic, sizeof(magic)) != 0) {
+		std::cerr << "GSRawDEM: " << p << " is not a raw DEM file." << std::endl;
+		close();
+		return false;
+	}
+	if (h.byteOrder != byteOrderMark) {
+		std::cerr << "GSRawDEM: " << p << " was written with another byte order." << std::endl;
+		close();
+		return false;
+	}
+
+	cellType = (GSRawType_t) h.type;
+	size_t size = cellSize(cellType);
+	if (size == 0 || h.rows > 0x7fffffff || h.cols > 0x7fffffff || h.stride < h.cols
+			|| h.offset < headerSize || h.offset % size != 0) {
+		std::cerr << "GSRawDEM: " << p << " has an invalid header." << std::endl;
+		close();
+		return false;
+	}
+	nRows = (int) h.rows, nCols = (int) h.cols;
+	rowStride = (long) h.stride;
+	offset = (size_t) h.offset;
+
+	return map(writable);
+}
+
+Boolean GSRawDEM::create(const std::string& p, GSRawType_t t, int r, int c) {
+	Header_t h;
+
+	close();
+	path = p;
+	if (cellSize(t) == 0 || r < 0 || c < 0) {
+		std::cerr << "GSRawDEM: invalid type or size for " << p << '.' << std::endl;
+		return false;
+	}
+	fd = ::open(p.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "GSRawDEM: cannot create " << p << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	memset(& h, 0, sizeof(h));
+	memcpy(h.magic, magic, sizeof(magic));
+	h.byteOrder = byteOrderMark;
+	h.type = t;
+	h.rows = r, h.cols = c, h.stride = c;
+	h.offset = headerSize;
+	cellType = t;
+	nRows = r, nCols = c;
+	rowStride = c;
+	offset = headerSize;
+
+	if (::write(fd, & h, sizeof(h)) != (ssize_t) sizeof(h)
+			|| ftruncate(fd, (off_t) (offset + (size_t) r * c * cellSize(t))) != 0) {
+		std::cerr << "GSRawDEM: cannot write " << p << ": " << strerror(errno) << std::endl;
+		close();
+		return false;
+	}
+	return map(true);
+}
+
+Boolean GSRawDEM::map(Boolean writable) {
+	struct stat st;
+
+	length = offset + ((size_t) (nRows > 0? nRows - 1 : 0) * rowStride + (nRows > 0? nCols : 0)) * cellSize(cellType);
+	if (fstat(fd, & st) != 0 || (size_t) st.st_size < length) {
+		std::cerr << "GSRawDEM: " << path << " is shorter than its header says." << std::endl;
+		close();
+		return false;
+	}
+	length = (size_t) st.st_size;
+	void* p = mmap(NULL, length, writable? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		std::cerr << "GSRawDEM: cannot map " << path << ": " << strerror(errno) << std::endl;
+		base = NULL;
+		close();
+		return false;
+	}
+	base = (char*) p;
+	return true;
+}
+
+Boolean GSRawDEM::sync() {
+	if (base == NULL)
+		return false;
+	if (msync(base, length, MS_SYNC) != 0) {
+		std::cerr << "GSRawDEM: cannot write " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void GSRawDEM::close() {
+	if (base != NULL)
+		munmap(base, length);
+	if (fd >= 0)
+		::close(fd);
+	base = NULL;
+	fd = -1;
+	length = 0;
+}
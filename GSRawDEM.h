@@ -0,0 +1,100 @@
+/*************************************************************************************************
+ * Raw DEM files
+ *
+ * A raw DEM file is a 64-byte header followed by the cells, uncompressed and in the byte order
+ * of the machine that wrote them, row after row:
+ *
+ *   offset  size  field
+ *        0     8  magic "GSDEM\0\0\1"
+ *        8     4  byte order mark 0x01020304, as written by the machine that wrote the file
+ *       12     4  cell type (GSRawType_t)
+ *       16     8  rows
+ *       24     8  columns
+ *       32     8  row stride, in cells (>= columns)
+ *       40     8  offset of the first cell, in bytes from the start of the file
+ *       48    16  reserved (0)
+ *
+ * GSRawDEM maps such a file into memory with mmap(2), so that GSFloodFill can fill the cells in
+ * place, in the page cache: there is nothing to decode on input nor to encode on output, and
+ * the pages are only read as the fill reaches them. A file can also be filled out of core with
+ * GSStreamFloodFill, passing it dataOffset() and stride().
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSRawDEM_H__
+#define   __GSRawDEM_H__
+
+#include <string>
+#include <cstddef>		// size_t
+#include <cstdint>		// uint64_t, int16_t, ...
+
+typedef bool Boolean;
+
+typedef enum {
+	GS_RAW_U8  = 1,		// unsigned char
+	GS_RAW_I16 = 2,		// short
+	GS_RAW_U16 = 3,		// unsigned short
+	GS_RAW_I32 = 4,		// int
+	GS_RAW_F32 = 5,		// float
+	GS_RAW_F64 = 6		// double
+} GSRawType_t;
+
+// Cell type of T
+template <typename T> struct GSRawTypeOf;
+template <> struct GSRawTypeOf<uint8_t>  { static const GSRawType_t value = GS_RAW_U8; };
+template <> struct GSRawTypeOf<int16_t>  { static const GSRawType_t value = GS_RAW_I16; };
+template <> struct GSRawTypeOf<uint16_t> { static const GSRawType_t value = GS_RAW_U16; };
+template <> struct GSRawTypeOf<int32_t>  { static const GSRawType_t value = GS_RAW_I32; };
+template <> struct GSRawTypeOf<float>    { static const GSRawType_t value = GS_RAW_F32; };
+template <> struct GSRawTypeOf<double>   { static const GSRawType_t value = GS_RAW_F64; };
+
+class GSRawDEM {
+	public:
+		GSRawDEM();
+		~GSRawDEM();
+
+		// Whether path starts with the magic of a raw DEM file
+		static Boolean isRaw(const std::string& path);
+
+		// Maps an existing file, read-only or for reading and writing
+		Boolean open(const std::string& path, Boolean writable);
+
+		// Creates (or truncates) a file for a DEM of r rows of c cells and maps it for writing
+		Boolean create(const std::string& path, GSRawType_t type, int r, int c);
+
+		// Flushes the changes to disk; without it, the kernel writes them back in its own time
+		Boolean sync(void);
+		void close(void);
+
+		GSRawType_t type(void) const { return cellType; }
+		int rows(void) const { return nRows; }
+		int cols(void) const { return nCols; }
+		long stride(void) const { return rowStride; }	// in cells
+		size_t dataOffset(void) const { return offset; }	// in bytes
+		static size_t cellSize(GSRawType_t t);
+
+		// The cells, if they are of type T (NULL otherwise)
+		template <typename T>
+		T* data(void) {
+			return (base != NULL && cellType == GSRawTypeOf<T>::value)? (T*) (base + offset) : NULL;
+		}
+
+		GSRawDEM(const GSRawDEM&) = delete;
+		GSRawDEM& operator=(const GSRawDEM&) = delete;
+
+	private:
+		int fd;
+		char* base;			// the mapping of the whole file
+		size_t length;
+		std::string path;
+
+		GSRawType_t cellType;
+		int nRows, nCols;
+		long rowStride;
+		size_t offset;
+
+		Boolean map(Boolean writable);
+};
+
+#endif /* __GSRawDEM_H__ */
@@ -0,0 +1,166 @@
+/*************************************************************************************************
+ * Spill-over graph of the tiled Priority-Flood
+ *
+ * The nodes are watershed labels, label 0 being the ocean; an edge joins two labels at the
+ * lowest elevation at which water crosses from one to the other. GSFloodFill records the edges
+ * between the labels of a tile, and GSParallelFloodFill and GSStreamFloodFill those between the
+ * tiles and towards the ocean, then solve() gives the water level of every label.
+ *
+ * The edges are kept in one vector of (a << 32 | b, z), a < b, to which add() appends. When the
+ * vector is full, it is compacted first (sorted, and the duplicates of every pair merged into
+ * the lowest elevation), and only grows by half if that freed less than a quarter of it: it holds
+ * less than 2 entries per distinct edge, and keeps its storage across clear(). peakBytes() bounds
+ * the memory the graph takes, up to and including solve(), so that GSStreamFloodFill can count
+ * it against its budget.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSSpillGraph_H__
+#define   __GSSpillGraph_H__
+
+#include <cstdint>		// uint64_t, int32_t
+#include <cstddef>		// size_t
+#include <vector>
+#include <queue>
+#include <utility>		// std::pair
+#include <functional>	// std::greater
+#include <limits>		// std::numeric_limits
+#include <algorithm>	// std::sort, std::max, std::swap
+
+#include "GSAllocCounter.h"
+
+typedef bool Boolean;
+
+template <typename T>
+class GSSpillGraph {
+	public:
+		typedef std::pair<uint64_t, T> Edge_t;
+		typedef std::vector< Edge_t, GSCountingAllocator<Edge_t> > Edges_t;
+
+		GSSpillGraph() : isSorted(true) { }
+
+		// Joins labels a and b at elevation z (or at a lower elevation already recorded)
+		void add(int32_t a, int32_t b, T z) {
+			if (a == b) return;
+			if (a > b) std::swap(a, b);
+			if (edges.size() == edges.capacity() && edges.size() >= minCompaction) {
+				compact();
+				if (edges.size() > edges.capacity() / 4 * 3)
+					edges.reserve(edges.capacity() + edges.capacity() / 2);
+			}
+			edges.push_back(Edge_t(((uint64_t) a << 32) | (uint32_t) b, z));
+			isSorted = false;
+		}
+		// Joins label a to the ocean
+		void addOcean(int32_t a) { add(0, a, std::numeric_limits<T>::lowest()); }
+
+		// Whether cell (i, j) of a DEM of r rows of c cells is one of the cells that
+		// GSFloodFill::Transform() seeds, which drain into the ocean
+		static Boolean drainsToOcean(int i, int j, int r, int c) {
+			return (r > 1)? (i == 0 || i == r-1 || j == 0 || j == c-1) : (j == 0 || j == c-1);
+		}
+
+		static int32_t first(const Edge_t& e) { return (int32_t) (e.first >> 32); }
+		static int32_t second(const Edge_t& e) { return (int32_t) (e.first & 0xffffffff); }
+
+		// The distinct edges, sorted by label pair
+		const Edges_t& sorted(void) { compact(); return edges; }
+
+		void clear(void) { edges.clear(); isSorted = true; }
+		size_t size(void) const { return edges.size(); }
+
+		// Most bytes the graph of nLabels labels holds at once until its storage next grows:
+		// while it grows (the old and the new vector), or while it is solved
+		size_t peakBytes(int32_t nLabels) const {
+			size_t held = edges.capacity() * sizeof(Edge_t);
+			return held + std::max(held + held / 2, solveBytes(nLabels, edges.size()));
+		}
+		// The same, planned for a graph of nLabels labels that has not been built yet: about
+		// edgesPerLabel distinct edges per label
+		static size_t plannedBytes(size_t nLabels) {
+			size_t held = nLabels * edgesPerLabel * 2 * sizeof(Edge_t);
+			return held + std::max(held + held / 2, solveBytes(nLabels, nLabels * edgesPerLabel));
+		}
+
+		void solve(int32_t nLabels, std::vector<T>& level);
+
+	private:
+		enum { minCompaction = 4096 };		// smaller graphs just grow
+		enum { edgesPerLabel = 4 };			// of the tiles of a DEM, for plannedBytes()
+		Edges_t edges;
+		Boolean isSorted;					// no duplicates either
+
+		typedef std::pair<int32_t, T> Arc_t;
+		typedef std::pair<T, int32_t> Entry_t;
+
+		// Bytes that solve() allocates for n labels and at most e edges, levels included
+		static size_t solveBytes(size_t n, size_t e) {
+			return (2 * n + 1) * sizeof(size_t) + n * sizeof(T) + n / 8 + 1
+				+ 2 * e * sizeof(Arc_t) + (2 * e + 1) * sizeof(Entry_t);
+		}
+
+		void compact(void);
+};
+
+template <typename T>
+void GSSpillGraph<T>::compact() {
+	size_t k, n = 0;
+
+	if (isSorted)
+		return;
+	std::sort(edges.begin(), edges.end());		// by label pair, then by elevation
+	for (k=0; k<edges.size(); k++)
+		if (n == 0 || edges[k].first != edges[n - 1].first)
+			edges[n++] = edges[k];
+	edges.resize(n);
+	isSorted = true;
+}
+
+//
+// Priority-flood of the graph from the ocean: level[l] is the water level of label l, the
+// lowest elevation at which water can leave it. The edges are consumed.
+//
+template <typename T>
+void GSSpillGraph<T>::solve(int32_t nLabels, std::vector<T>& level) {
+	int32_t k;
+	size_t e;
+
+	compact();
+
+	// Adjacency lists
+	std::vector< size_t, GSCountingAllocator<size_t> > head(nLabels + 1, 0);
+	for (e=0; e<edges.size(); e++) {
+		head[first(edges[e]) + 1]++;
+		head[second(edges[e]) + 1]++;
+	}
+	for (k=0; k<nLabels; k++)
+		head[k + 1] += head[k];
+	std::vector< Arc_t, GSCountingAllocator<Arc_t> > adj(head[nLabels]);
+	std::vector< size_t, GSCountingAllocator<size_t> > fill(head.begin(), head.end() - 1);
+	for (e=0; e<edges.size(); e++) {
+		adj[ fill[first(edges[e])]++ ] = Arc_t(second(edges[e]), edges[e].second);
+		adj[ fill[second(edges[e])]++ ] = Arc_t(first(edges[e]), edges[e].second);
+	}
+	Edges_t().swap(edges);
+	isSorted = true;
+
+	level.assign(nLabels, std::numeric_limits<T>::lowest());
+	std::vector< Boolean, GSCountingAllocator<Boolean> > done(nLabels, false);
+	std::priority_queue< Entry_t, std::vector< Entry_t, GSCountingAllocator<Entry_t> >,
+		std::greater<Entry_t> > open;
+	open.push(Entry_t(std::numeric_limits<T>::lowest(), 0));
+	while (! open.empty()) {
+		Entry_t top = open.top();
+		open.pop();
+		if (done[top.second])
+			continue;
+		done[top.second] = true;
+		level[top.second] = top.first;
+		for (e = head[top.second]; e < head[top.second + 1]; e++)
+			if (! done[adj[e].first])
+				open.push(Entry_t(std::max(top.first, adj[e].second), adj[e].first));
+	}
+}
+
+#endif /* __GSSpillGraph_H__ */
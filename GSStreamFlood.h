@@ -0,0 +1,352 @@
+/*************************************************************************************************
+ * Out-of-core Priority-Flood
+ *
+ * GSStreamFloodFill fills a DEM stored in a raw file (rows of cells of type T, in native byte
+ * order) that need not fit in memory, with the tiled algorithm of GSParallelFloodFill (see
+ * GSParallelFlood.h) and the "evict" strategy of the article:
+ * Barnes, R. "Parallel Priority-Flood Depression Filling for Trillion Cell Digital Elevation
+ * Models on Desktops or Clusters". Computers & Geosciences. Vol 96, Nov 2016, pp 56-68,
+ * doi: 10.1016/j.cageo.2016.07.001.
+ *
+ *   - first pass: every tile is read from the file and filled from its own perimeter, with
+ *     watershed labels. Only a summary of the tile is kept: its spill-over edges, and the
+ *     filled elevation and label of the cells along its bottom row and right column, which the
+ *     tiles below and to the right join to their own perimeters. The file is not modified.
+ *   - the spill-over graph is solved, which gives the water level of every label;
+ *   - second pass: every tile is read and filled again (giving the same labels), raised to the
+ *     water levels of its labels, and written back to the file.
+ *
+ * Each cell is therefore read twice and written once. The tiles are sized so that one tile and
+ * its scratch storage fit in the memory budget (setMemoryBudget, 1 GiB by default), together
+ * with the summary of one row of tiles and the spill-over graph (see GSSpillGraph.h), whose size
+ * is proportional to the number of perimeter cells of the tiles: smaller tiles take less memory
+ * each, but give a larger graph. The graph is checked against the budget as it grows, and
+ * Transform() fails, before it writes anything, if it would exceed the budget.
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSStreamFlood_H__
+#define   __GSStreamFlood_H__
+
+#include <string>
+#include <vector>
+#include <cmath>		// std::sqrt
+#include <cstring>		// strerror
+#include <cerrno>		// errno
+#include <fcntl.h>		// open
+#include <unistd.h>		// pread, pwrite, close
+#include <sys/types.h>	// off_t
+
+using namespace std;
+
+template <typename T, int Connectivity = 8>
+class GSStreamFloodFill {
+	public:
+
+		// DEM of r rows of c cells in file `path', starting `offset' bytes into the file, with
+		// consecutive rows `stride' cells apart (default: c)
+		GSStreamFloodFill(const string& path, int r, int c, off_t offset = 0, long stride = 0);
+		Boolean Transform(void);
+
+		int verbose;
+		void setVerbose(int v) { verbose = v; }
+		void setMemoryBudget(size_t bytes) { budget = bytes; }
+		void setTileSize(int r, int c) { tileRows = r; tileCols = c; sizedByBudget = false; }	// overrides the budget
+
+	private:
+
+		string path;
+		int rows, cols;
+		off_t offset;
+		long stride;
+		int fd;
+
+		size_t budget;
+		int tileRows, tileCols;
+		Boolean sizedByBudget;
+
+		// One engine and one buffer for all the tiles
+		GSFloodFill<T, Connectivity> floodFill;
+		vector<T> buffer;
+
+		// Filled elevation and global label of the row above the current row of tiles (upZ,
+		// upL, for all columns), of the bottom row of the current row of tiles (downZ, downL),
+		// of the column left of the current tile (leftZ, leftL) and of its right column
+		// (rightZ, rightL)
+		vector<T> upZ, downZ, leftZ, rightZ;
+		vector<int32_t> upL, downL, leftL, rightL;
+
+		// Spill-over graph between the global labels; label 0 is the ocean
+		GSSpillGraph<T> spill;
+		int32_t nLabels;
+		vector<int32_t> labelBase;	// global label = labelBase[tile] + tile label
+
+		static size_t bytesPerCell(void) { return 2 * sizeof(T) + sizeof(int32_t) + 2 * sizeof(Cell_t) + 1; }
+		size_t stripBytes(int tr) { return (2 * (size_t) cols + 2 * (size_t) tr) * (sizeof(T) + sizeof(int32_t)); }
+		size_t plannedBytes(int tr, int tc);
+		void chooseTileSize(void);
+		Boolean withinBudget(void);
+		Boolean io(Boolean write, int r0, int c0, int h, int w);
+		Boolean fillTile(int r0, int c0, int h, int w);
+		void summarizeTile(int r0, int c0, int h, int w, int32_t base);
+		void raiseTile(int h, int w, int32_t base, const vector<T>& level);
+};
+
+//
+// Constructor
+//
+template <typename T, int Connectivity>
+GSStreamFloodFill<T, Connectivity>::GSStreamFloodFill(const string& p, int r, int c, off_t o, long s) {
+	path = p;
+	rows = r, cols = c;
+	offset = o;
+	stride = (s > 0)? s : c;
+	fd = -1;
+	verbose = 0;
+	budget = (size_t) 1 << 30;
+	tileRows = tileCols = 0;
+	sizedByBudget = false;
+	nLabels = 0;
+}
+
+//
+// Memory planned for tiles of tr x tc cells: per cell, the tile buffer, a label, a Pit entry and
+// an Open entry (roughly), and a bit of Closed; the summaries of a row of tiles; and the
+// spill-over graph, with one label per perimeter cell of every tile
+//
+template <typename T, int Connectivity>
+size_t GSStreamFloodFill<T, Connectivity>::plannedBytes(int tr, int tc) {
+	size_t nTiles = (size_t) ((rows + tr - 1) / tr) * ((cols + tc - 1) / tc);
+	size_t perimeter = (tr > 2 && tc > 2)? 2 * (size_t) (tr + tc) - 4 : (size_t) tr * tc;
+
+	return (size_t) tr * tc * bytesPerCell() + stripBytes(tr)
+		+ nTiles * sizeof(int32_t) + GSSpillGraph<T>::plannedBytes(nTiles * perimeter + 1);
+}
+
+//
+// Largest tiles whose planned memory fits in the budget. Smaller tiles add perimeter cells, so
+// the tiles shrink until they fit, down to 64x64 cells; if none fits, the tiles that need the
+// least memory are used.
+//
+template <typename T, int Connectivity>
+void GSStreamFloodFill<T, Connectivity>::chooseTileSize() {
+	if (tileRows > 0 && tileCols > 0 && ! sizedByBudget) {
+		tileRows = std::min(tileRows, rows);
+		tileCols = std::min(tileCols, cols);
+		return;
+	}
+
+	sizedByBudget = true;
+	size_t cells = (budget > stripBytes(0))? (budget - stripBytes(0)) / bytesPerCell() : 0;
+	cells = std::min(cells, (size_t) std::numeric_limits<int32_t>::max() / 2);
+	size_t least = std::numeric_limits<size_t>::max();
+	int leastRows = 0, leastCols = 0;
+	for (;;) {
+		cells = std::max(cells, (size_t) 64 * 64);
+		tileCols = (int) std::min((size_t) cols, std::max((size_t) 1, (size_t) std::sqrt((double) cells)));
+		tileRows = (int) std::min((size_t) rows, cells / tileCols);
+		size_t bytes = plannedBytes(tileRows, tileCols);
+		if (bytes <= budget)
+			return;
+		if (bytes < least)
+			least = bytes, leastRows = tileRows, leastCols = tileCols;
+		if (cells == 64 * 64)
+			break;
+		cells -= cells / 8;
+	}
+	tileRows = leastRows, tileCols = leastCols;
+	std::cerr << "GSStreamFloodFill: a budget of " << budget << " bytes is too small for "
+		<< rows << 'x' << cols << " cells (" << least << " bytes planned); using tiles of "
+		<< tileRows << 'x' << tileCols << " cells." << std::endl;
+}
+
+//
+// Whether the tile storage, the summaries and the spill-over graph so far, once solved, fit in
+// the budget; only checked when the tiles were sized by the budget
+//
+template <typename T, int Connectivity>
+Boolean GSStreamFloodFill<T, Connectivity>::withinBudget() {
+	if (! sizedByBudget)
+		return true;
+	size_t bytes = (size_t) tileRows * tileCols * bytesPerCell() + stripBytes(tileRows)
+		+ labelBase.capacity() * sizeof(int32_t) + spill.peakBytes(nLabels);
+	if (bytes <= budget)
+		return true;
+	std::cerr << "GSStreamFloodFill: the spill-over graph of " << path << " (" << nLabels
+		<< " labels, " << spill.size() << " edges) exceeds the budget of " << budget
+		<< " bytes; raise it, or set the tile size." << std::endl;
+	return false;
+}
+
+//
+// Reads (or writes) the tile of h x w cells at (r0, c0) from (or to) buffer, one row at a time
+//
+template <typename T, int Connectivity>
+Boolean GSStreamFloodFill<T, Connectivity>::io(Boolean write, int r0, int c0, int h, int w) {
+	for (int i=0; i<h; i++) {
+		char* p = (char*) & buffer[(size_t) i * w];
+		size_t n = (size_t) w * sizeof(T);
+		off_t at = offset + ((off_t) (r0 + i) * stride + c0) * (off_t) sizeof(T);
+		while (n > 0) {
+			ssize_t done = write? pwrite(fd, p, n, at) : pread(fd, p, n, at);
+			if (done < 0 && errno == EINTR)
+				continue;
+			if (done <= 0) {
+				std::cerr << "GSStreamFloodFill: cannot " << (write? "write" : "read") << ' ' << path
+					<< " at row " << r0 + i << ": " << (done < 0? strerror(errno) : "end of file")
+					<< std::endl;
+				return false;
+			}
+			p += done, n -= done, at += done;
+		}
+	}
+	return true;
+}
+
+//
+// Reads the tile of h x w cells at (r0, c0) and fills it from its own perimeter, with labels
+//
+template <typename T, int Connectivity>
+Boolean GSStreamFloodFill<T, Connectivity>::fillTile(int r0, int c0, int h, int w) {
+	if (! io(false, r0, c0, h, w))
+		return false;
+	floodFill.setDEM(& buffer[0], h, w);
+	floodFill.labelling = floodFill.spilling = floodFill.wholePerimeter = true;
+	return floodFill.Transform();
+}
+
+//
+// First pass: records the spill-over edges of the filled tile at (r0, c0), within the tile,
+// towards the tiles above and to the left (which are already filled), and towards the ocean
+//
+template <typename T, int Connectivity>
+void GSStreamFloodFill<T, Connectivity>::summarizeTile(int r0, int c0, int h, int w, int32_t base) {
+	typedef GSNeighborhood<Connectivity> Nbh_t;
+	int i, j, k;
+
+	const typename GSSpillGraph<T>::Edges_t& tileSpill = floodFill.Spill.sorted();
+	for (size_t e=0; e<tileSpill.size(); e++)
+		spill.add(base + GSSpillGraph<T>::first(tileSpill[e]), base + GSSpillGraph<T>::second(tileSpill[e]),
+			tileSpill[e].second);
+
+	for (i=0; i<h; i++)
+		for (j=0; j<w; j++) {
+			if (i != 0 && i != h-1 && j != 0 && j != w-1) {
+				j = w - 2;	// skip the interior of the tile
+				continue;
+			}
+			Cell_t c = (Cell_t) i * w + j;
+			int32_t a = base + floodFill.label(c);
+			T za = buffer[c];
+			int gi = r0 + i, gj = c0 + j;
+
+			if (GSSpillGraph<T>::drainsToOcean(gi, gj, rows, cols))
+				spill.addOcean(a);
+
+			for (k=0; k<Nbh_t::n; k++) {
+				int ni = gi + Nbh_t::di[k], nj = gj + Nbh_t::dj[k];
+				if (ni < 0 || nj < 0 || nj >= cols || ni >= r0 + h)
+					continue;
+				if (ni < r0)
+					spill.add(a, upL[nj], std::max(za, upZ[nj]));
+				else if (nj < c0)
+					spill.add(a, leftL[ni - r0], std::max(za, leftZ[ni - r0]));
+			}
+
+			if (i == h-1) {
+				downZ[gj] = za;
+				downL[gj] = a;
+			}
+			if (j == w-1) {
+				rightZ[i] = za;
+				rightL[i] = a;
+			}
+		}
+	leftZ.swap(rightZ);
+	leftL.swap(rightL);
+}
+
+//
+// Second pass: raises the refilled tile to the water levels of its labels
+//
+template <typename T, int Connectivity>
+void GSStreamFloodFill<T, Connectivity>::raiseTile(int h, int w, int32_t base, const vector<T>& level) {
+	for (Cell_t c=0; c<(Cell_t) h * w; c++)
+		buffer[c] = std::max(buffer[c], level[base + floodFill.label(c)]);
+}
+
+
+//
+// Main function (out-of-core flood-fill transform)
+//
+template <typename T, int Connectivity>
+Boolean GSStreamFloodFill<T, Connectivity>::Transform() {
+	int r0, c0, h, w;
+	size_t t;
+
+	if (rows <= 0 || cols <= 0)
+		return true;
+
+	fd = open(path.c_str(), O_RDWR);
+	if (fd < 0) {
+		std::cerr << "GSStreamFloodFill: cannot open " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	chooseTileSize();
+	buffer.resize((size_t) tileRows * tileCols);
+	upZ.resize(cols), downZ.resize(cols), leftZ.resize(tileRows), rightZ.resize(tileRows);
+	upL.resize(cols), downL.resize(cols), leftL.resize(tileRows), rightL.resize(tileRows);
+	spill.clear();
+	labelBase.clear();
+	nLabels = 1;
+
+	if (verbose)
+		std::cout << "Filling " << path << " in tiles of " << tileRows << 'x' << tileCols
+			<< " cells." << std::endl;
+
+	Boolean ok = true;
+	for (r0=0; r0<rows && ok; r0+=tileRows) {
+		h = std::min(tileRows, rows - r0);
+		for (c0=0; c0<cols && ok; c0+=tileCols) {
+			w = std::min(tileCols, cols - c0);
+			ok = fillTile(r0, c0, h, w);
+			if (! ok)
+				break;
+			labelBase.push_back(nLabels - 1);
+			summarizeTile(r0, c0, h, w, nLabels - 1);
+			nLabels += floodFill.nLabels;
+			ok = withinBudget();
+		}
+		upZ.swap(downZ);
+		upL.swap(downL);
+	}
+
+	if (ok) {
+		if (verbose)
+			std::cout << "Spill-over graph: " << nLabels << " labels, " << spill.sorted().size()
+				<< " edges." << std::endl;
+
+		vector<T> level;
+		spill.solve(nLabels, level);
+
+		for (r0=0, t=0; r0<rows && ok; r0+=tileRows) {
+			h = std::min(tileRows, rows - r0);
+			for (c0=0; c0<cols && ok; c0+=tileCols, t++) {
+				w = std::min(tileCols, cols - c0);
+				ok = fillTile(r0, c0, h, w);
+				if (ok) {
+					raiseTile(h, w, labelBase[t], level);
+					ok = io(true, r0, c0, h, w);
+				}
+			}
+		}
+	}
+
+	close(fd);
+	fd = -1;
+	return ok;
+}
+
+#endif /* __GSStreamFlood_H__ */
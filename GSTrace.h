@@ -0,0 +1,145 @@
+/*************************************************************************************************
+ * Tracing policies for the Priority-Flood Algorithm
+ *
+ * GSFloodFill reports what it does to every cell (popped from Open or Pit, raised, pushed onto
+ * Open or Pit, found closed) to its Trace template parameter. The hooks are guarded by the
+ * compile-time constant Trace::enabled, so with the default GSNoTrace they are compiled away
+ * and the inner loop of Transform() carries no test for tracing at all.
+ *
+ *   - GSNoTrace: no tracing (the default).
+ *   - GSRingTrace: the last `capacity' events, as fixed-size binary records in a ring buffer
+ *     that is dumped after the run (dump() as text, save() as raw records), so that a traced
+ *     run is not slowed down by formatting and writing a line per cell.
+ *   - GSStreamTrace: one line per event on a stream, as it happens (slow, for small DEMs).
+ *
+ * A policy is any class with a `static const bool enabled' and a method
+ *   void event(GSTraceEvent_t e, int row, int col, double z);
+ * where z is the elevation of the cell after the event (its former elevation for GS_TRACE_RAISE).
+ *
+ * By Eidon (eidon@tutanota.be), 2016-10-22.
+ *
+ *************************************************************************************************/
+#ifndef   __GSTrace_H__
+#define   __GSTrace_H__
+
+#include <cstdint>		// uint32_t, uint64_t
+#include <cstddef>		// size_t
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+typedef bool Boolean;
+
+typedef enum {
+	GS_TRACE_POP_OPEN  = 1,		// the cell was popped from Open
+	GS_TRACE_POP_PIT   = 2,		// the cell was popped from Pit
+	GS_TRACE_CLOSED    = 3,		// the neighbor was already closed, and is ignored
+	GS_TRACE_RAISE     = 4,		// the neighbor is raised from elevation z
+	GS_TRACE_PUSH_OPEN = 5,		// the neighbor is pushed onto Open
+	GS_TRACE_PUSH_PIT  = 6,		// the neighbor is pushed onto Pit
+	GS_TRACE_EPSILON   = 7		// the epsilon gradient of a pit reaches beyond the depression
+} GSTraceEvent_t;
+
+inline const char *GSTraceEventName(GSTraceEvent_t e) {
+	switch (e) {
+	case GS_TRACE_POP_OPEN:  return "pop Open";
+	case GS_TRACE_POP_PIT:   return "pop Pit";
+	case GS_TRACE_CLOSED:    return "closed";
+	case GS_TRACE_RAISE:     return "raise";
+	case GS_TRACE_PUSH_OPEN: return "push Open";
+	case GS_TRACE_PUSH_PIT:  return "push Pit";
+	case GS_TRACE_EPSILON:   return "epsilon beyond depression";
+	}
+	return "?";
+}
+
+//
+// No tracing
+//
+class GSNoTrace {
+	public:
+		static const bool enabled = false;
+		void event(GSTraceEvent_t, int, int, double) { }
+};
+
+//
+// The last events, in a ring buffer of binary records
+//
+class GSRingTrace {
+	public:
+		static const bool enabled = true;
+
+		typedef struct {
+			int32_t row, col;
+			uint32_t event;		// GSTraceEvent_t
+			uint32_t reserved;
+			double z;
+		} Record_t;
+
+		// capacity is rounded up to a power of two
+		explicit GSRingTrace(size_t capacity = 1 << 20) : head(0) {
+			size_t n = 1;
+			while (n < capacity) n <<= 1;
+			ring.resize(n);
+			mask = n - 1;
+		}
+
+		void event(GSTraceEvent_t e, int row, int col, double z) {
+			Record_t& r = ring[head++ & mask];
+			r.row = row, r.col = col;
+			r.event = e;
+			r.reserved = 0;
+			r.z = z;
+		}
+
+		// Events recorded since the last clear(), of which the last size() are kept
+		uint64_t count(void) const { return head; }
+		size_t size(void) const { return (head < ring.size())? (size_t) head : ring.size(); }
+		const Record_t& operator[](size_t k) const { return ring[(head - size() + k) & mask]; }	// oldest first
+		void clear(void) { head = 0; }
+
+		// One line per kept event, oldest first
+		void dump(std::ostream& out) const {
+			if (head > ring.size())
+				out << "(" << head - ring.size() << " earlier events dropped)" << std::endl;
+			for (size_t k = 0; k < size(); k++) {
+				const Record_t& r = (*this)[k];
+				out << GSTraceEventName((GSTraceEvent_t) r.event) << " (" << r.row << ',' << r.col
+					<< ") " << r.z << '\n';
+			}
+			out.flush();
+		}
+
+		// The kept events as raw Record_t, oldest first, in the byte order of this machine
+		Boolean save(const std::string& path) const {
+			std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+			for (size_t k = 0; k < size() && out; k++)
+				out.write((const char*) & (*this)[k], sizeof(Record_t));
+			return (Boolean) out;
+		}
+
+	private:
+		std::vector<Record_t> ring;
+		size_t mask;
+		uint64_t head;		// events recorded so far; the next one goes to ring[head & mask]
+};
+
+//
+// One line per event on a stream (by default std::cerr)
+//
+class GSStreamTrace {
+	public:
+		static const bool enabled = true;
+
+		explicit GSStreamTrace(std::ostream& o = std::cerr) : out(& o) { }
+
+		void event(GSTraceEvent_t e, int row, int col, double z) {
+			*out << GSTraceEventName(e) << " (" << row << ',' << col << ") " << z << '\n';
+		}
+
+	private:
+		std::ostream* out;
+};
+
+#endif /* __GSTrace_H__ */
@@ -12,6 +12,10 @@
  *
  *************************************************************************************************/
 #include "GSPriorityFlood.h"
+#include "GSPixelKernels.h"
+#include "GSRawDEM.h"
+#include "ppmb_io.hpp"
+#include "phase.h"
 
 #include <string.h>
 #include <iostream>
@@ -21,8 +25,14 @@
 #include <iomanip>		// std::setprecision
 #include <limits>		// std::numeric_limits
 #include <vector>
-#include <algorithm>	// std::max
+#include <algorithm>	// std::max, std::transform
+#include <cctype>		// tolower
 #include <queue>
+#include <cstdlib>		// atoi
+#include <chrono>		// std::chrono::steady_clock
+#include <thread>		// std::thread::hardware_concurrency
+#include <memory>		// std::unique_ptr
+#include <glob.h>		// glob, for batches of input files
 
 // OpenCV includes
 //#include <cv.h>
@@ -44,152 +54,614 @@ const string mversion = "preliminary, 0.3, 2016-10-22";
 #define NaN		-9999.0  // std::numeric_limits<Real>::min()
 
 void printHelp();
-void fromRGB2Mat(Mat& img, unsigned char **r, unsigned char **g, unsigned char **b);
-void fromMat2RGB(Mat& img, unsigned char **r, unsigned char **g, unsigned char **b);
 Boolean diffMat(Mat& dst, Mat& src);
 
+//
+// One flood-fill driver per pixel depth, kept across the images of a batch; each instantiation
+// gets the priority queue that GSPrioQueueSelector picks for its elevations (see GSPrioQueue.h)
+//
+class GSImageFloodFill {
+	public:
+		GSImageFloodFill(PFAlgorithm_t algorithm, PFLayout_t layout, int verbose, int threads, Phase* phases)
+				: u8(0, 0), u16(0, 0), s16(0, 0), s32(0, 0), f32(0, 0), f64(0, 0) {
+			configure(u8, algorithm, layout, verbose, threads, phases);
+			configure(u16, algorithm, layout, verbose, threads, phases);
+			configure(s16, algorithm, layout, verbose, threads, phases);
+			configure(s32, algorithm, layout, verbose, threads, phases);
+			configure(f32, algorithm, layout, verbose, threads, phases);
+			configure(f64, algorithm, layout, verbose, threads, phases);
+		}
+
+		GSMultiBandFloodFill<unsigned char> u8;		// CV_8U
+		GSMultiBandFloodFill<unsigned short> u16;	// CV_16U
+		GSMultiBandFloodFill<short> s16;			// CV_16S
+		GSMultiBandFloodFill<int> s32;				// CV_32S
+		GSMultiBandFloodFill<float> f32;			// CV_32F
+		GSMultiBandFloodFill<double> f64;			// CV_64F
+
+	private:
+		template <typename T>
+		static void configure(GSMultiBandFloodFill<T>& floodFill, PFAlgorithm_t algorithm, PFLayout_t layout,
+				int verbose, int threads, Phase* phases) {
+			floodFill.setVerbose(verbose);
+			floodFill.setAlgorithm(algorithm);
+			floodFill.setLayout(layout);
+			floodFill.setThreads(threads);
+			floodFill.setPhase(phases);
+		}
+};
+
+void addInputs(vector<string>& iFileNames, const char *arg);
+string outputName(const string& dest, const string& iFileName, Boolean batch);
+string defaultOutputName(const string& extension);
+Boolean keepsDepth(const string& fileName, int depth);
+Boolean processImage(const string& iFileName, const string& oFileName, const string& dFileName,
+		GSImageFloodFill& floodFill, Mat& src, Mat& dst, Mat& diff, Boolean headless, int threads,
+		Phase* phases);
+Boolean processRaw(const string& iFileName, const string& oFileName, const string& lFileName,
+		const string& fFileName, PFAlgorithm_t algorithm, PFLayout_t layout, int threads, int verbose,
+		size_t budget, Phase* phases);
+Boolean isPNM16(const string& iFileName);
+Boolean processPNM16(const string& iFileName, const string& oFileName, const string& dFileName,
+		GSImageFloodFill& floodFill, Phase* phases);
+
 int main(int argc, char *argv[])
 {
-	int i, j;
-	string iFileName;
+	int i;
+	vector<string> iFileNames;
 	string oFileName;
 	string dFileName;
+	string lFileName;
+	string fFileName;
+	string pFileName;
 	Mat src, dst, diff;
 	string XSDPath;
-	int rows, cols;
-	Boolean error;
+	Boolean batch, headless, counters;
 	int verbose;
+	PFAlgorithm_t algorithm;
+	PFLayout_t layout;
+	int threads;
+	size_t budget;
+	int failed;
 
 	verbose=0;
+	headless=false;
+	counters=false;
+	budget=0;
+	algorithm=PF_IMPROVED;
+	layout=PF_ROWS;
+	threads=std::max(1, (int) std::thread::hardware_concurrency());
 	// manage command-line args
 	if (argc>1)
-	for (i=1; i<argc; i++)
-		if (argv[i][0] == '-')
+	for (i=1; i<argc; i++) {
+		if (argv[i][0] != '-') {	// input file or pattern
+			addInputs(iFileNames, argv[i]);
+			continue;
+		}
 		switch(argv[i][1]) {
 		case 'v': verbose=1; break;
 		case 'h': printHelp(); return 0;
-		case 'i': iFileName = argv[++i]; break;
+		case 'i': addInputs(iFileNames, argv[++i]); break;
 		case 'o': oFileName = argv[++i]; break;
 		case 'd': dFileName = argv[++i]; break;
+		case 'l': lFileName = argv[++i]; break;
+		case 'f': fFileName = argv[++i]; break;
+		case 'p': pFileName = argv[++i]; break;
+		case 'c': counters=true; break;
 		case 'x': XSDPath = argv[++i]; break;
+		case 'n': headless=true; break;
+		case 'b': layout=PF_TILED; break;
+		case 'a': algorithm = (PFAlgorithm_t) atoi(argv[++i]);
+				  if (algorithm < PF_ORIGINAL || algorithm > PF_EPSILON) {
+					  std::cerr << "Option -a accepts 1, 2 or 3.\n" << std::endl;
+					  printHelp();
+					  return -1;
+				  }
+				  break;
+		case 't': threads = atoi(argv[++i]);
+				  if (threads < 1) threads = 1;
+				  break;
+		case 'm': budget = (size_t) atol(argv[++i]) << 20;
+				  break;
 
 		default: std::cerr << "Unknown switch.\n" << std::endl;
 				 printHelp();
 				 return -1;
 		}
+	}
 
 
 
-	if (iFileName.empty()) {
+	if (iFileNames.empty()) {
 		std::cerr << "Option -i <filename> must be present! Aborting...\n";
 		return -1;
 	}
+
+	if (verbose)
+		std::cout << "Pixel kernels: " << GSPixelKernelsISA() << ".\n";
+
+	// With several inputs, -o and -d name directories that receive one file per input
+	batch = iFileNames.size() > 1;
 	if (oFileName.empty()) {
-		std::cerr << "Option -o <filename> is missing. Output file name is set to 'output.jpg'\n";
-		oFileName = "output.jpg";
+		if (batch) {
+			std::cerr << "Option -o <directory> must be present with several input files! Aborting...\n";
+			return -1;
+		}
+		// left empty: the extension of the default output file depends on the depth of the
+		// input, which OpenCV tells only once the image is read (see defaultOutputName)
 	}
 
-	src = imread(iFileName, cv::IMREAD_COLOR);
-	namedWindow("Input image", CV_WINDOW_AUTOSIZE );
-	imshow("Input image", src );
+	// The phases of every image are timed only with -p or -c; the report is written when phases
+	// is destroyed, after the last image
+	std::unique_ptr<Phase> phases;
+	if (counters && pFileName.empty())
+		pFileName = "-";
+	if (! pFileName.empty()) {
+		phases.reset(new Phase());
+		phases->SetFilename(pFileName);
+		phases->SetThreadName("main");
+		if (counters)
+			phases->EnableCounters();
+	}
 
-	std::cout << "Image " << iFileName << " consists of " << src.channels() << " channels and "
-		<< src.cols << "x" << src.rows << " pixels.\n";
+	// One driver per depth for all the images: its per-band engines keep their Closed masks and
+	// queue storage, and src, dst and diff keep their buffers while the images have the same size
+	GSImageFloodFill floodFill(algorithm, layout, verbose, threads, phases.get());
+
+	failed = 0;
+	for (size_t f=0; f<iFileNames.size(); f++) {
+		Phase::Scope scope(phases.get(), iFileNames[f]);
+		if (GSRawDEM::isRaw(iFileNames[f])) {
+			if (! processRaw(iFileNames[f], outputName(oFileName, iFileNames[f], batch),
+					lFileName.empty()? lFileName : outputName(lFileName, iFileNames[f], batch),
+					fFileName.empty()? fFileName : outputName(fFileName, iFileNames[f], batch),
+					algorithm, layout, threads, verbose, budget, phases.get()))
+				failed++;
+		} else if (isPNM16(iFileNames[f])) {
+			if (! processPNM16(iFileNames[f], outputName(oFileName, iFileNames[f], batch),
+					dFileName.empty()? dFileName : outputName(dFileName, iFileNames[f], batch),
+					floodFill, phases.get()))
+				failed++;
+		} else if (! processImage(iFileNames[f], outputName(oFileName, iFileNames[f], batch),
+				dFileName.empty()? dFileName : outputName(dFileName, iFileNames[f], batch),
+				floodFill, src, dst, diff, headless, threads, phases.get()))
+			failed++;
+	}
 
-	//dst = imread(iFileName, CV_LOAD_IMAGE_COLOR); //src.clone();
-	src.copyTo(dst);
+	if (batch)
+		std::cout << iFileNames.size() - failed << " of " << iFileNames.size() << " images processed.\n";
+	return failed? -1 : 0;
+}
 
-	cols = src.cols;
-	rows = src.rows;
+//
+// Appends the files matched by arg, which may be a glob(3) pattern such as 'dems/*.png'
+//
+void addInputs(vector<string>& iFileNames, const char *arg) {
+	glob_t g;
+
+	if (arg == NULL)
+		return;
+	if (strpbrk(arg, "*?[") == NULL) {
+		iFileNames.push_back(arg);
+		return;
+	}
+	if (glob(arg, 0, NULL, &g) != 0) {
+		std::cerr << "No file matches '" << arg << "'.\n";
+		return;
+	}
+	for (size_t k=0; k<g.gl_pathc; k++)
+		iFileNames.push_back(g.gl_pathv[k]);
+	globfree(&g);
+}
 
-	unsigned char **r, **g, **b;
-	unsigned char *buffr, *buffg, *buffb;
+//
+// Destination of iFileName: dest itself, or dest/<basename of iFileName> in batch mode
+//
+string outputName(const string& dest, const string& iFileName, Boolean batch) {
+	if (! batch)
+		return dest;
+	size_t slash = iFileName.find_last_of('/');
+	string base = (slash == string::npos)? iFileName : iFileName.substr(slash + 1);
+	return (dest.empty() || dest[dest.size() - 1] == '/')? dest + base : dest + '/' + base;
+}
 
-	r = new unsigned char *[rows];
-	g = new unsigned char *[rows];
-	b = new unsigned char *[rows];
+//
+// The output file name when option -o is missing, with the extension of a format that holds
+// the samples of the input
+//
+string defaultOutputName(const string& extension) {
+	string name = "output." + extension;
+	std::cerr << "Option -o <filename> is missing. Output file name is set to '" << name << "'\n";
+	return name;
+}
 
-	buffr = new unsigned char[ cols * rows ];
-	buffg = new unsigned char[ cols * rows ];
-	buffb = new unsigned char[ cols * rows ];
+//
+// Whether imwrite keeps samples of the given OpenCV depth in the format named by the extension
+// of fileName, rather than converting them to 8 bits
+//
+Boolean keepsDepth(const string& fileName, int depth) {
+	size_t dot = fileName.find_last_of('.');
+	string ext = (dot == string::npos || fileName.find('/', dot) != string::npos)? string() : fileName.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	if (ext == "tif" || ext == "tiff")
+		return true;
+	switch (depth) {
+	case CV_8U:  return true;
+	case CV_16U: return ext == "png" || ext == "pgm" || ext == "ppm" || ext == "pnm" || ext == "jp2";
+	case CV_32F: return ext == "exr" || ext == "pfm";
+	default:     return false;
+	}
+}
 
-	for (int i=0, disp=0; i<rows; i++, disp += cols)
-		r[i] = & buffr[disp];
-	for (int i=0, disp=0; i<rows; i++, disp += cols)
-		g[i] = & buffg[disp];
-	for (int i=0, disp=0; i<rows; i++, disp += cols)
-		b[i] = & buffb[disp];
+//
+// Fills the channels of img in place, as strided views of its interleaved pixels of type T
+// (consecutive rows img.step[0] bytes apart, consecutive pixels img.channels() elements apart);
+// they are independent, so they are filled concurrently
+//
+template <typename T>
+Boolean fillMat(Mat& img, GSMultiBandFloodFill<T>& floodFill) {
+	int i;
+
+	floodFill.setSize(img.rows, img.cols, (int) (img.step[0] / sizeof(T)), img.channels());
+	floodFill.clearBands();
+	for (i=0; i<img.channels(); i++)
+		floodFill.addBand(img.ptr<T>() + i);
+	if (! floodFill.Transform())
+		return false;
+	for (i=0; i<img.channels(); i++)
+		if (floodFill.isTiled(i))		// the tiles do not know the final elevations
+			std::cout << "Channel " << i << " (in tiles): " << floodFill.getOpenPushes(i) << " cells pushed onto Open, "
+				<< floodFill.getPitPushes(i) << " onto Pit, n/a raised; " << floodFill.getBytesAllocated(i)
+				<< " bytes allocated.\n";
+		else
+			std::cout << "Channel " << i << ": " << floodFill.getOpenPushes(i) << " cells pushed onto Open, "
+				<< floodFill.getPitPushes(i) << " onto Pit, " << floodFill.getStats(i).raised << " raised, at most "
+				<< floodFill.getStats(i).peakOpen << " on Open; " << floodFill.getBytesAllocated(i) << " bytes allocated.\n";
+	return true;
+}
+
+//
+// Flood-fills one image into oFileName, and its difference with the input into dFileName
+// (if not empty). The image is read with its own depth and dispatched to the GSFloodFill of
+// that depth, so 16-bit and floating-point DEMs keep their precision; output files whose
+// format cannot hold that depth are refused, and an empty oFileName defaults to output.jpg for
+// 8-bit images and to output.tif for deeper ones. The GUI windows are
+// skipped in headless mode. Decoding, filling, encoding and differencing are timed as phases
+// (if phases is not NULL).
+//
+Boolean processImage(const string& iFileName, const string& oFileName, const string& dFileName,
+		GSImageFloodFill& floodFill, Mat& src, Mat& dst, Mat& diff, Boolean headless, int threads,
+		Phase* phases) {
+	Boolean ok;
+
+	{
+		Phase::Scope scope(phases, "decode");
+		src = imread(iFileName, cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+	}
+	if (src.empty()) {
+		std::cerr << "Could not read image " << iFileName << ". Skipping...\n";
+		return false;
+	}
+	if (! headless) {
+		namedWindow("Input image", CV_WINDOW_AUTOSIZE );
+		imshow("Input image", src );
+	}
+
+	std::cout << "Image " << iFileName << " consists of " << src.channels() << " channels of "
+		<< src.elemSize1() * 8 << " bits and " << src.cols << "x" << src.rows << " pixels.\n";
+
+	// imwrite would silently reduce a 16-bit or floating-point DEM to 8 bits in a format that
+	// cannot hold its samples, such as JPEG
+	string oName = oFileName.empty()? defaultOutputName((src.depth() == CV_8U)? "jpg" : "tif") : oFileName;
+	const string* names[] = { &oName, &dFileName };
+	for (const string* name : names)
+		if (! name->empty() && ! keepsDepth(*name, src.depth())) {
+			std::cerr << "The format of " << *name << " cannot hold the " << src.elemSize1() * 8
+				<< "-bit samples of " << iFileName << " (use e.g. .tif). Skipping...\n";
+			return false;
+		}
+
+	{
+		Phase::Scope scope(phases, "copy");
+		src.copyTo(dst);	// reallocates only if the size or type changed
+	}
 
-	fromMat2RGB(src, r, g, b);
+	std::chrono::steady_clock::time_point fillStart = std::chrono::steady_clock::now();
+
+	{
+		Phase::Scope scope(phases, "fill");
+		switch (dst.depth()) {
+		case CV_8U:  ok = fillMat(dst, floodFill.u8);  break;
+		case CV_16U: ok = fillMat(dst, floodFill.u16); break;
+		case CV_16S: ok = fillMat(dst, floodFill.s16); break;
+		case CV_32S: ok = fillMat(dst, floodFill.s32); break;
+		case CV_32F: ok = fillMat(dst, floodFill.f32); break;
+		case CV_64F: ok = fillMat(dst, floodFill.f64); break;
+		default:
+			std::cerr << "Image " << iFileName << " has an unsupported pixel depth. Skipping...\n";
+			return false;
+		}
+	}
+	if (! ok) {
+		std::cerr << "floodFill.Transform has failed on " << iFileName << "!\n";
+		return false;
+	}
+
+	std::chrono::duration<double> fillTime = std::chrono::steady_clock::now() - fillStart;
+	std::cout << "Flood-fill of the " << dst.channels() << " channels took " << fillTime.count() << "s with "
+		<< threads << " thread(s).\n";
+
+	// Now dst is the flood-filled transformation of the input bands
+
+	if (! headless) {
+		namedWindow( "Flood-filled image", CV_WINDOW_AUTOSIZE );
+		imshow("Flood-filled image", dst );
+	}
+
+	{
+		Phase::Scope scope(phases, "encode");
+		if (! imwrite(oName, dst )) {
+			std::cerr << "Could not write image " << oName << "!\n";
+			return false;
+		}
+	}
 
-	/*
-	unsigned char *origr, *origg, *origb;
 	if (! dFileName.empty()) {
-		origr = new unsigned char[ cols * rows ];
-		origg = new unsigned char[ cols * rows ];
-		origb = new unsigned char[ cols * rows ];
-		int rxc = rows*cols;
-		for (i=0; i<rxc; i++) {
-			origr[i] = buffr[i];
-			origg[i] = buffg[i];
-			origb[i] = buffb[i];
+		{
+			Phase::Scope scope(phases, "difference");
+			dst.copyTo(diff);
+			diffMat(diff, src);
+		}
+
+		if (! headless) {
+			namedWindow( "Difference image", CV_WINDOW_AUTOSIZE );
+			imshow("Difference image", diff );
+		}
+		Phase::Scope scope(phases, "encode difference");
+		if (! imwrite(dFileName, diff )) {
+			std::cerr << "Could not write image " << dFileName << "!\n";
+			return false;
 		}
 	}
-	*/
 
-	GSFloodFill<unsigned char> *floodFill;
+	if (! headless)
+		waitKey(0);
+	return true;
+}
 
+inline void dumpTrace(GSNoTrace&) { }
+inline void dumpTrace(GSRingTrace& trace) { trace.dump(std::cerr); }
+
+//
+// Fills the cells of a raw DEM file in place with GSFloodFill, tracing them with Trace
+// (see GSTrace.h)
+//
+template <typename T, typename Trace>
+Boolean fillRawSerial(GSRawDEM& raw, PFAlgorithm_t algorithm, PFLayout_t layout, int verbose) {
+	GSFloodFill<T, 8, typename GSPrioQueueSelector<T, Cell_t>::type, Trace>
+		floodFill(raw.data<T>(), raw.rows(), raw.cols(), (int) raw.stride());
+	floodFill.setVerbose(verbose);
+	floodFill.setAlgorithm(algorithm);
+	floodFill.setLayout(layout);
+	GSFloodStats_t stats;
+	if (! floodFill.Transform(& stats))
+		return false;
+	dumpTrace(floodFill.getTrace());
+	std::cout << stats.openPushes << " cells pushed onto Open (at most " << stats.peakOpen << " at a time), "
+		<< stats.pitPushes << " onto Pit (at most " << stats.peakPit << "), " << stats.raised << " raised; "
+		<< "seeding took " << stats.seedSeconds << "s, draining " << stats.drainSeconds << "s.\n";
+	return true;
+}
 
-	floodFill = new GSFloodFill<unsigned char>(r, rows, cols);
-	floodFill->setVerbose(verbose);
-	if (! floodFill->Transform()) {
-		std::cerr << "floodFill.Transform (r) has failed! Aborting...\n";
-		return -1;
+//
+// Fills the cells of a raw DEM file in place: mapped in memory, or out of core within budget
+// bytes (if not 0). If labels or flow is not NULL, the watershed labels or the D8 flow
+// directions of the cells are written into it in the same pass, which needs the serial fill
+// in memory. The tiles of the parallel fill are timed as phases (if phases is not NULL).
+//
+template <typename T>
+Boolean fillRaw(GSRawDEM& raw, const string& path, GSRawDEM* labels, GSRawDEM* flow,
+		PFAlgorithm_t algorithm, PFLayout_t layout, int threads, int verbose, size_t budget,
+		Phase* phases) {
+	if (labels != NULL || flow != NULL) {
+		GSFloodFill<T> floodFill(raw.data<T>(), raw.rows(), raw.cols(), (int) raw.stride());
+		floodFill.setVerbose(verbose);
+		floodFill.setAlgorithm(algorithm);
+		floodFill.setLayout(layout);
+		if (flow != NULL)
+			floodFill.setFlowDirections(flow->data<uint8_t>(), (int) flow->stride());
+		if (labels == NULL)
+			return floodFill.Transform();
+		if (! floodFill.Label(labels->data<int32_t>(), (int) labels->stride()))
+			return false;
+		std::cout << floodFill.getLabelCount() << " watersheds labelled.\n";
+		return true;
 	}
-	delete floodFill;
 
-	floodFill = new GSFloodFill<unsigned char>(g, rows, cols);
-	//GSFloodFill<unsigned char> floodFill(g, rows, cols);
-	floodFill->setVerbose(verbose);
-	if (! floodFill->Transform()) {
-		std::cerr << "floodFill.Transform (g) has failed! Aborting...\n";
-		return -1;
+	if (budget > 0) {
+		GSStreamFloodFill<T> floodFill(path, raw.rows(), raw.cols(), (off_t) raw.dataOffset(), raw.stride());
+		floodFill.setVerbose(verbose);
+		floodFill.setMemoryBudget(budget);
+		return floodFill.Transform();
 	}
-	delete floodFill;
 
-	floodFill = new GSFloodFill<unsigned char>(b, rows, cols);
-	//GSFloodFill<unsigned char> floodFill(b, rows, cols);
-	floodFill->setVerbose(verbose);
-	if (! floodFill->Transform()) {
-		std::cerr << "floodFill.Transform (b) has failed! Aborting...\n";
-		return -1;
+	// as GSMultiBandFloodFill, the tiled fill reproduces Algorithms 1 and 2, not 3, and only
+	// pays off on DEMs of several tiles
+	if (threads > 1 && algorithm != PF_EPSILON && GSParallelFloodFill<T>::spansTiles(raw.rows(), raw.cols())) {
+		GSParallelFloodFill<T> floodFill(raw.data<T>(), raw.rows(), raw.cols(), (int) raw.stride());
+		floodFill.setVerbose(verbose);
+		floodFill.setThreads(threads);
+		floodFill.setAlgorithm(algorithm);
+		floodFill.setLayout(layout);
+		floodFill.setPhase(phases);
+		return floodFill.Transform();
 	}
-	delete floodFill;
 
+	// verbose runs record the events of the cells, and print the last ones after the fill
+	if (verbose)
+		return fillRawSerial<T, GSRingTrace>(raw, algorithm, layout, verbose);
+	return fillRawSerial<T, GSNoTrace>(raw, algorithm, layout, verbose);
+}
+
+//
+// Flood-fills a raw DEM file (see GSRawDEM.h) into oFileName, and writes the watershed label of
+// every cell into the raw DEM of int32 cells lFileName and its D8 flow direction into the raw
+// DEM of uint8 cells fFileName (if not empty). The input is copied to oFileName, unless they
+// are the same file, which is then filled in place (an empty oFileName defaults to
+// output.gsdem); either way the cells are filled where they are, in the page cache, with no
+// decoding or encoding. Copying, mapping and filling are timed as phases (if phases is not
+// NULL).
+//
+Boolean processRaw(const string& iFileName, const string& oFileName, const string& lFileName,
+		const string& fFileName, PFAlgorithm_t algorithm, PFLayout_t layout, int threads, int verbose,
+		size_t budget, Phase* phases) {
+	GSRawDEM raw, labels, flow;
+	string oName = oFileName.empty()? defaultOutputName("gsdem") : oFileName;
+	Boolean ok;
+
+	if ((! lFileName.empty() || ! fFileName.empty()) && budget > 0) {
+		std::cerr << "Watershed labels and flow directions are computed in memory; option -m is ignored.\n";
+		budget = 0;
+	}
 
-	// Now r, g and b point to the flood-filled transformation of the three input bands
+	if (oName != iFileName) {
+		Phase::Scope scope(phases, "copy");
+		std::ifstream in(iFileName.c_str(), std::ios::binary);
+		std::ofstream out(oName.c_str(), std::ios::binary | std::ios::trunc);
+		if (! (out << in.rdbuf())) {
+			std::cerr << "Could not copy " << iFileName << " to " << oName << "!\n";
+			return false;
+		}
+	}
 
-	// (r,g,b) => dst
-	fromRGB2Mat(dst, r, g, b);
+	{
+		Phase::Scope scope(phases, "map");
+		// the out-of-core fill reads and writes the file itself
+		if (! raw.open(oName, budget == 0))
+			return false;
+		if (! lFileName.empty() && ! labels.create(lFileName, GS_RAW_I32, raw.rows(), raw.cols()))
+			return false;
+		if (! fFileName.empty() && ! flow.create(fFileName, GS_RAW_U8, raw.rows(), raw.cols()))
+			return false;
+	}
+	GSRawDEM* lp = lFileName.empty()? NULL : & labels;
+	GSRawDEM* fp = fFileName.empty()? NULL : & flow;
+
+	std::cout << "Raw DEM " << iFileName << " consists of " << raw.rows() << "x" << raw.cols()
+		<< " cells of " << GSRawDEM::cellSize(raw.type()) << " bytes.\n";
+	if (budget > 0 && algorithm == PF_EPSILON)
+		std::cerr << "Option -a 3 is not supported out of core; using -a 2.\n";
+
+	std::chrono::steady_clock::time_point fillStart = std::chrono::steady_clock::now();
+
+	{
+		Phase::Scope scope(phases, "fill");
+		switch (raw.type()) {
+		case GS_RAW_U8:  ok = fillRaw<uint8_t> (raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		case GS_RAW_I16: ok = fillRaw<int16_t> (raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		case GS_RAW_U16: ok = fillRaw<uint16_t>(raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		case GS_RAW_I32: ok = fillRaw<int32_t> (raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		case GS_RAW_F32: ok = fillRaw<float>   (raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		case GS_RAW_F64: ok = fillRaw<double>  (raw, oName, lp, fp, algorithm, layout, threads, verbose, budget, phases); break;
+		default: ok = false;
+		}
+	}
+	if (! ok) {
+		std::cerr << "The flood-fill of " << iFileName << " has failed!\n";
+		return false;
+	}
 
-	namedWindow( "Flood-filled image", CV_WINDOW_AUTOSIZE );
-	imshow("Flood-filled image", dst );
+	std::chrono::duration<double> fillTime = std::chrono::steady_clock::now() - fillStart;
+	std::cout << "Flood-fill took " << fillTime.count() << "s.\n";
+	return true;
+}
 
-	imwrite("FloodFilled.jpg", dst );
+//
+// Whether iFileName is a binary PGM or PPM file of 16 bits per sample, which OpenCV would
+// read as 8 bits per sample
+//
+Boolean isPNM16(const string& iFileName) {
+	std::ifstream input(iFileName.c_str(), std::ios::binary);
+	char magic[2];
+	int channels, xsize, ysize, maxval;
+
+	if (! input.read(magic, 2) || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+		return false;
+	input.seekg(0);
+	std::streambuf* coutBuf = std::cout.rdbuf(NULL);	// ppmb_io reports errors on cout
+	Boolean error = pnmb_read_header(input, channels, xsize, ysize, maxval);
+	std::cout.rdbuf(coutBuf);
+	return ! error && maxval > 255;
+}
 
+//
+// Flood-fills a 16-bit PGM or PPM file into oFileName (output.pgm or output.ppm if empty),
+// and its difference with the input into dFileName (if not empty), without OpenCV: the
+// channels are read into planes by pnmb_read (see ppmb_io.cpp) and filled as 16-bit
+// elevations by the CV_16U driver of floodFill, which is kept across the images of a batch.
+// Decoding, filling, encoding and differencing are timed as phases (if phases is not NULL).
+//
+Boolean processPNM16(const string& iFileName, const string& oFileName, const string& dFileName,
+		GSImageFloodFill& floodFill, Phase* phases) {
+	int xsize, ysize, maxval, channels, k;
+	unsigned short *data;
+	unsigned short *planes[3];
+
+	{
+		Phase::Scope scope(phases, "decode");
+		if (pnmb_read(iFileName, xsize, ysize, maxval, channels, &data))
+			return false;
+	}
 
+	size_t n = (size_t) xsize * ysize;
+	std::cout << "Image " << iFileName << " consists of " << channels << " channels of 16 bits and "
+		<< xsize << "x" << ysize << " pixels.\n";
+	string oName = oFileName.empty()? defaultOutputName((channels == 1)? "pgm" : "ppm") : oFileName;
 
+	vector<unsigned short> src;
 	if (! dFileName.empty()) {
-		dst.copyTo(diff);
-		diffMat(diff, src);
+		Phase::Scope scope(phases, "copy");
+		src.assign(data, data + channels * n);
+	}
+
+	std::chrono::steady_clock::time_point fillStart = std::chrono::steady_clock::now();
+
+	floodFill.u16.setSize(ysize, xsize);
+	floodFill.u16.clearBands();
+	for (k=0; k<channels; k++) {
+		planes[k] = data + k * n;
+		floodFill.u16.addBand(planes[k]);
+	}
+	Boolean ok;
+	{
+		Phase::Scope scope(phases, "fill");
+		ok = floodFill.u16.Transform();
+	}
+
+	std::chrono::duration<double> fillTime = std::chrono::steady_clock::now() - fillStart;
+	if (ok)
+		std::cout << "Flood-fill of the " << channels << " channels took " << fillTime.count() << "s.\n";
+	else
+		std::cerr << "floodFill.Transform has failed on " << iFileName << "!\n";
 
-		namedWindow( "Difference image", CV_WINDOW_AUTOSIZE );
-		imshow("Difference image", diff );
-		imwrite("Difference.jpg", diff );
+	if (ok) {
+		Phase::Scope scope(phases, "encode");
+		ok = ! pnmb_write(oName, xsize, ysize, channels, maxval, planes);
 	}
 
-	waitKey(0);
-	return 0;
+	if (ok && ! dFileName.empty()) {
+		{
+			Phase::Scope scope(phases, "difference");
+			for (size_t c=0; c<channels * n; c++)
+				data[c] = (data[c] > src[c])? data[c] - src[c] : 0;
+		}
+		Phase::Scope scope(phases, "encode difference");
+		ok = ! pnmb_write(dFileName, xsize, ysize, channels, maxval, planes);
+	}
+
+	delete [] data;
+	return ok;
 }
 
 void printHelp() {
@@ -205,54 +677,72 @@ std::cerr <<
 	" *\n" <<
 	" * By Vincenzo De Florio, 2016-10-20.\n" <<
 	" *\n" <<
-	" * Version: " << mversion << std::endl;
+	" * Version: " << mversion << std::endl <<
+	"\n" <<
+	" Usage: FloodFill -i input-image [-o output-image] [-d difference-image] [-l labels] [-f flow] [-a 1|2|3] [-t threads] [-b] [-n] [-v] [-p phases] [-c]\n" <<
+	"        FloodFill -n -o output-dir [-d difference-dir] [options] input-image|'pattern' ...\n" <<
+	"   -i f   input image; may be repeated, and may be a quoted glob pattern such as 'dems/*.png'\n" <<
+	"   -o f   output image (default: output.jpg for 8-bit images, output.tif for deeper ones, refusing\n" <<
+	"          formats that cannot hold the depth of the input); with several input images, the\n" <<
+	"          directory of the output images\n" <<
+	"   -d f   difference image; with several input images, the directory of the difference images\n" <<
+	"   -n     headless: no windows, no waiting for a key (for batch jobs without a display)\n" <<
+	"   -v     verbose: a summary of every fill, and for raw DEM files filled on one thread the last\n" <<
+	"          2^20 events of the cells (pops, raises, pushes), printed after the fill\n" <<
+	"   -p f   time the phases of every input (decoding, copying, filling every channel, encoding, ...)\n" <<
+	"          with a monotonic clock, and write them to f as CSV (f.csv), JSON (f.json), Chrome trace\n" <<
+	"          events with one track per thread (f.trace.json, for chrome://tracing or the Perfetto UI)\n" <<
+	"          or a table (any other name; - for the standard output)\n" <<
+	"   -c     with the times of the phases (-p, by default on the standard output), their CPU cycles,\n" <<
+	"          instructions, cache misses and branch misses, where Linux allows perf_event_open(2)\n" <<
+	"   -b     fill a copy of the DEM laid out in tiles of 64x64 cells, faster on large DEMs\n" <<
+	"   -m n   fill raw DEM files (see GSRawDEM.h) out of core, in tiles that fit in n MiB of memory\n" <<
+	"   -l f   watershed labels of a raw DEM file, written to f as a raw DEM of int32 cells (in memory,\n" <<
+	"          serially); with several input files, the directory of the label files\n" <<
+	"   -f f   D8 flow directions of a raw DEM file (1 = east, 2 = south-east, ..., 128 = north-east, 0 at\n" <<
+	"          the edges), written to f as a raw DEM of uint8 cells; as -l, and in the same pass\n" <<
+	"   Raw DEM files are filled where they are, mapped in memory; an output name equal to the input\n" <<
+	"   name fills the input file in place, without copying it. Option -d does not apply to them.\n" <<
+	"   Binary PGM and PPM files of 16 bits per sample are read, filled and written without OpenCV.\n" <<
+	"   Images keep their depth (8 or 16 bits, integral or floating-point): write 16-bit results to PNG\n" <<
+	"   or TIFF files and floating-point results to TIFF files, as JPEG only holds 8 bits.\n" <<
+	"   -a 1   Algorithm 1, Priority-Flood (all cells go through the priority queue)\n" <<
+	"   -a 2   Algorithm 2, Improved Priority-Flood (default)\n" <<
+	"   -a 3   Algorithm 3, Priority-Flood+epsilon (no effect on integral elevations)\n" <<
+	"   -t n   fill the channels concurrently on n threads (default: all cores); threads beyond the number of\n" <<
+	"          channels go to the tiled parallel priority-flood of each channel larger than 1024x1024\n";
 }
 
-void fromRGB2Mat(Mat& img, unsigned char **r, unsigned char **g, unsigned char **b) {
-	for(int y = 0; y < img.rows; y++){
-		for(int x = 0; x < img.cols; x++){
-			Vec3b& intensity = img.at<Vec3b>(y, x);
-			uchar& blu = intensity.val[0];
-			uchar& gre = intensity.val[1];
-			uchar& red = intensity.val[2];
-
-			blu = b[y][x];
-			gre = g[y][x];
-			red = r[y][x];
-		}
-	}
-}
-
-void fromMat2RGB(Mat& img, unsigned char **r, unsigned char **g, unsigned char **b) {
-	for(int y = 0; y < img.rows; y++){
-		for(int x = 0; x < img.cols; x++){
-			Vec3b& intensity = img.at<Vec3b>(y, x);
-			uchar& blu = intensity.val[0];
-			uchar& gre = intensity.val[1];
-			uchar& red = intensity.val[2];
-
-			b[y][x] = blu;
-			g[y][x] = gre;
-			r[y][x] = red;
-		}
+//
+// dst = dst - src, for the elements of type T (a flood-filled image is never below its source)
+//
+template <typename T>
+void subMat(Mat& dst, Mat& src) {
+	for(int y = 0; y < dst.rows; y++) {
+		T* d = dst.ptr<T>(y);
+		const T* s = src.ptr<T>(y);
+		for (size_t x = 0; x < (size_t) dst.cols * dst.channels(); x++)
+			d[x] = (d[x] > s[x])? d[x] - s[x] : 0;
 	}
 }
 
+//
+// dst = dst - src, saturated at 0; 8-bit images go through the kernel of GSPixelKernels.h
+//
 Boolean diffMat(Mat& dst, Mat& src) {
-	for(int y = 0; y < dst.rows; y++){
-		for(int x = 0; x < dst.cols; x++){
-			Vec3b& dintensity = dst.at<Vec3b>(y, x);
-			uchar& dblu = dintensity.val[0];
-			uchar& dgre = dintensity.val[1];
-			uchar& dred = dintensity.val[2];
-
-			Vec3b& sintensity = src.at<Vec3b>(y, x);
-			uchar& sblu = sintensity.val[0];
-			uchar& sgre = sintensity.val[1];
-			uchar& sred = sintensity.val[2];
-			dblu -= sblu;
-			dgre -= sgre;
-			dred -= sred;
-		}
+	if (dst.rows != src.rows || dst.cols != src.cols || dst.type() != src.type())
+		return false;
+	switch (dst.depth()) {
+	case CV_8U:
+		for(int y = 0; y < dst.rows; y++)
+			GSSubSat(dst.ptr(y), src.ptr(y), (size_t) dst.cols * dst.elemSize());
+		break;
+	case CV_16U: subMat<unsigned short>(dst, src); break;
+	case CV_16S: subMat<short>(dst, src); break;
+	case CV_32S: subMat<int>(dst, src); break;
+	case CV_32F: subMat<float>(dst, src); break;
+	case CV_64F: subMat<double>(dst, src); break;
+	default: return false;
 	}
+	return true;
 }
@@ -1,140 +1,510 @@
 /*************************************************************************************************
  * class Phase class
  *
- * This code allows the user to declare "phases" in his/her code
- * A phase is a string with a time of occurrence, expressed via  chrono::system_clock()
- * An object of class Phase registers those strings and their times of registration.
- * A summary of the time spent by the code in each phase is returned when the object is
- * destructed. The summary is printed either on std::cout or into a file, if so specified.
+ * This code allows the user to declare "phases" in his/her code and to time them.
+ * A phase is a named interval of time, measured with std::chrono::steady_clock (monotonic) in
+ * nanoseconds. Phases are opened and closed by the RAII object Phase::Scope, and can be nested:
+ *
+ *     Phase phases;
+ *     {
+ *         Phase::Scope s(phases, "fill");
+ *         ...
+ *         {   Phase::Scope t(phases, "fill channel 0"); ... }
+ *     }
+ *
+ * Set(name) is the older, flat interface: it closes the phase opened by the previous Set() and
+ * opens a new one.
+ *
+ * Every thread records its phases into its own buffer, without locking: a lock is only taken
+ * the first time a thread records into a Phase object, or after it has recorded into several
+ * other Phase objects in between. The buffers are merged when the report
+ * is written, which must be after the threads have closed their phases. Write() writes the
+ * report into the file named by SetFilename() (or on std::cout), as CSV if the name ends in
+ * ".csv", as Chrome trace events if it ends in ".trace.json", as JSON if it ends in ".json",
+ * as a table otherwise. The trace events (one complete event per phase, one track per thread)
+ * open in chrome://tracing or in the Perfetto UI, offline. The report is written by the
+ * destructor, unless Write() has been called or nothing has been recorded.
+ *
+ * On Linux, EnableCounters() also counts the CPU cycles, instructions, cache misses and branch
+ * misses of every phase with perf_event_open(2), one group of counters per thread, read when a
+ * phase opens and when it closes; the reports then add them (and the instructions per cycle) to
+ * the times. If the kernel does not allow it (no PMU, as in most virtual machines, or a
+ * restrictive /proc/sys/kernel/perf_event_paranoid), the phases are only timed.
  *
  * By Eidon (eidon@tutanota.be), 2016-10-27.
  *
- * Version: 1.0, Thu, Oct 27, 2016  1:45:27 PM
+ * Version: 2.0
  *
  *************************************************************************************************/
+#ifndef   __PHASE_H__
+#define   __PHASE_H__
 
-
-#include <string.h>
 #include <iostream>
 #include <fstream>
-#include <map>
-#include <utility>		// std::pair
-#include <iomanip>		// std::setprecision
-#include <limits>		// std::numeric_limits
+#include <sstream>
+#include <iomanip>		// std::setw, std::setprecision
+#include <string>
 #include <vector>
-#include <algorithm>	// std::max
-#include <queue>
-#include <cstring>		// strlen
-
-
-#include <time.h> 		// clock()
-#include <chrono>		// std::chrono::steady_clock::now()
-#include "deco.h"
+#include <memory>		// std::unique_ptr
+#include <mutex>
+#include <atomic>
+#include <algorithm>	// std::sort, std::max
+#include <chrono>		// std::chrono::steady_clock
+#include <cstdint>		// uint64_t
+#include <cstring>		// memset, strerror
+#include <cerrno>		// errno, ENOSYS
 
+#ifdef __linux__
+#include <linux/perf_event.h>	// perf_event_attr
+#include <sys/syscall.h>		// syscall, __NR_perf_event_open
+#include <unistd.h>				// read, close
+#endif
 
+typedef bool Boolean;
 
 class Phase {
-	typedef struct { std::chrono::time_point<std::chrono::system_clock> t; string s; } phase_t;
-
 	private:
-		int sp;
-		vector<phase_t> v;
-		map<string,int> m;
-		string outputFile;
-		size_t maxstring;
-		phase_t ph;
+		struct Buffer;
 
 	public:
-		Phase() { sp = 0; maxstring = 0; outputFile.clear(); }
-		~Phase();
-		void Set(string phase) {
-			ph.t = std::chrono::system_clock::now();
-			ph.s = phase;
-			v.push_back(ph);
-			m[phase] = sp;
-			//if (phase.length() > maxstring) maxstring = phase.length();
-			maxstring = std::max(maxstring, phase.length());
-			sp++;
-		}
-		phase_t Get(string phase) {
-			return v[ m[ phase ] ];
-		}
-		phase_t Get(int phase) {
-			return v[ phase ];
-		}
-		int GetIndex(string phase) {
-			return m[ phase ];
-		}
-		std::chrono::time_point<std::chrono::system_clock> GetTime(int i) {
-			return v[ i ].t;
-		}
-		std::chrono::time_point<std::chrono::system_clock> GetTime(string s) {
-			return v[ m[ s ] ].t;
-		}
-		string GetString(int i) {
-			return v[ i ].s;
-		}
-		string SetFilename(string s) {
-			if (s != "-")
-				outputFile = s;
-			else
-				outputFile.clear();
+		// Hardware events counted by EnableCounters()
+		enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, N_COUNTERS };
+		static const char* CounterName(int k) {
+			static const char* names[N_COUNTERS] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+			return names[k];
+		}
+
+		// A closed phase: times in nanoseconds since the Phase object was constructed
+		typedef struct {
+			std::string name;
+			int thread;			// 0, 1, ... in the order in which the threads first recorded a phase
+			int depth;			// 0 for the outermost phases of the thread
+			uint64_t start, end;
+			uint64_t counter[N_COUNTERS];	// events during the phase...
+			unsigned counted;				// ... bit k set if counter[k] is known
+		} Record_t;
+
+		Phase() : serial(++Serials()), counting(false), setOpen(false), written(false) {
+			epoch = std::chrono::steady_clock::now();
+		}
+		~Phase() {
+			if (! written && ! buffers.empty())
+				Write();
+		}
+
+		// Opens a phase in the constructor and closes it in the destructor. A NULL Phase
+		// records nothing, so that code can be instrumented optionally.
+		class Scope {
+			public:
+				Scope(Phase& p, const std::string& name) : phase(& p) { index = phase->begin(name, buf); }
+				Scope(Phase* p, const std::string& name) : phase(p) { if (phase) index = phase->begin(name, buf); }
+				~Scope() { if (phase) phase->end(buf, index); }
+
+				Scope(const Scope&) = delete;
+				Scope& operator=(const Scope&) = delete;
+			private:
+				Phase* phase;
+				Buffer* buf;
+				size_t index;
+		};
+
+		// Closes the phase opened by the last Set() and opens a new one
+		void Set(const std::string& phase) {
+			if (setOpen)
+				end(setBuf, setIndex);
+			setIndex = begin(phase, setBuf);
+			setOpen = true;
+		}
+
+		// Counts hardware events per phase, from now on (see above); returns false if the kernel
+		// does not allow it on the calling thread
+		Boolean EnableCounters(void) {
+			Buffer* b = buffer();
+			int error = openCounters(b);
+			if (error != 0) {
+				b->closeCounters();
+				std::cerr << "Phase: no hardware counters (" << strerror(error) << ")"
+					<< ((error == EACCES || error == EPERM)? ", see /proc/sys/kernel/perf_event_paranoid" : "")
+					<< "; the phases are only timed." << std::endl;
+				return false;
+			}
+			counting = true;
+			return true;
+		}
+
+		// Names the calling thread in the trace events (default: "thread <n>")
+		void SetThreadName(const std::string& name) { buffer()->name = name; }
+
+		// Names the calling thread in the trace events of every Phase object it records into
+		// from now on, unless SetThreadName() names it otherwise; the tracks are shown by
+		// increasing order (default: n, in the order the threads first recorded a phase)
+		static void SetDefaultThreadName(const std::string& name, int order) {
+			ThreadDefaults().name = name;
+			ThreadDefaults().order = order;
+			ThreadDefaults().set = true;
+		}
+
+		// "-" is std::cout
+		std::string SetFilename(const std::string& s) {
+			outputFile = (s != "-")? s : std::string();
 			return outputFile;
 		}
-		int GetMaxLen(void) { return maxstring; }
-};
 
+		// The closed phases of all threads, by start time
+		std::vector<Record_t> Records(void) {
+			std::vector<Record_t> all;
+			std::lock_guard<std::mutex> lock(registry);
+			for (size_t t=0; t<buffers.size(); t++)
+				for (size_t k=0; k<buffers[t]->records.size(); k++)
+					if (buffers[t]->records[k].end != 0)
+						all.push_back(buffers[t]->records[k]);
+			std::stable_sort(all.begin(), all.end(),
+				[](const Record_t& a, const Record_t& b) { return a.start < b.start; });
+			return all;
+		}
 
-Phase::~Phase() {
-	FILE *f;
-	Deco deco;
-	int mid = -1;
-	int mmx = -1;
+		void WriteCSV(std::ostream& out) {
+			std::vector<Record_t> r = Records();
+			out << "thread,depth,name,start_ns,duration_ns";
+			for (int c=0; counting && c<N_COUNTERS; c++)
+				out << ',' << CounterName(c);
+			out << '\n';
+			for (size_t k=0; k<r.size(); k++) {
+				out << r[k].thread << ',' << r[k].depth << ',' << csv(r[k].name) << ','
+					<< r[k].start << ',' << r[k].end - r[k].start;
+				for (int c=0; counting && c<N_COUNTERS; c++)
+					if (has(r[k], c))
+						out << ',' << r[k].counter[c];
+					else
+						out << ',';
+				out << '\n';
+			}
+		}
 
-	std::chrono::duration<double> tall = GetTime(sp-1) - GetTime(0);
-	std::chrono::duration<double> tnow;
+		void WriteJSON(std::ostream& out) {
+			std::vector<Record_t> r = Records();
+			out << "{\"phases\":[";
+			for (size_t k=0; k<r.size(); k++)
+				out << (k? ",\n" : "\n") << "{\"thread\":" << r[k].thread << ",\"depth\":" << r[k].depth
+					<< ",\"name\":" << json(r[k].name) << ",\"start_ns\":" << r[k].start
+					<< ",\"duration_ns\":" << r[k].end - r[k].start << counters(r[k]) << '}';
+			out << "\n]}\n";
+		}
 
-	f = (outputFile.empty())? stdout : fopen(outputFile.c_str(), "w");
-	char format[256];
-	sprintf(format,
-	"From phase %%%dd (%%%ds) to phase %%%dd (%%%ds), %%s%%10lf%%ss elapsed (%%s%%lf%%%%%%s)\n",
-			to_string(sp).length(), maxstring, to_string(sp).length(), maxstring);
-	sprintf(format,
-	"From phase %%%dd (%%%ds) to phase %%%dd (%%%ds), %%10lfs elapsed (%%lf%%%%)\n",
-			to_string(sp).length(), maxstring, to_string(sp).length(), maxstring);
+		// Trace Event Format: complete ("X") events in microseconds, and the names and the order
+		// of the threads
+		void WriteTrace(std::ostream& out) {
+			std::vector<Record_t> r = Records();
+			out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			{
+				std::lock_guard<std::mutex> lock(registry);
+				for (size_t t=0; t<buffers.size(); t++)
+					out << (t? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+						<< ",\"args\":{\"name\":" << json(buffers[t]->name.empty()? "thread " + std::to_string(t)
+						: buffers[t]->name) << "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+						<< ",\"args\":{\"sort_index\":" << buffers[t]->order << "}}";
+			}
+			std::streamsize precision = out.precision();
+			out << std::fixed << std::setprecision(3);
+			for (size_t k=0; k<r.size(); k++)
+				out << ",\n{\"name\":" << json(r[k].name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << r[k].thread
+					<< ",\"ts\":" << r[k].start * 1e-3 << ",\"dur\":" << (r[k].end - r[k].start) * 1e-3
+					<< (r[k].counted? ",\"args\":{" + counters(r[k]).substr(1) + "}" : std::string()) << '}';
+			out << "\n]}\n";
+			out.unsetf(std::ios::fixed);
+			out.precision(precision);
+		}
 
-	std::cout << "Format = " << format << std::endl;
+		// One line per phase, indented by depth, with its share of the whole run
+		void WriteTable(std::ostream& out) {
+			std::vector<Record_t> r = Records();
+			uint64_t first = 0, last = 0;
+			size_t width = 5, longest = 0;
 
-	auto mall = std::chrono::duration_cast<std::chrono::milliseconds>(tall).count();
-	//std::cout << "Turn around time = " << mall/1000.0 << "s" << std::endl;
-	auto mnow = std::chrono::duration_cast<std::chrono::milliseconds>(tnow).count();
+			for (size_t k=0; k<r.size(); k++) {
+				first = k? std::min(first, r[k].start) : r[k].start;
+				last = std::max(last, r[k].end);
+				width = std::max(width, r[k].name.length() + 2 * r[k].depth);
+				if (r[k].depth == 0 && r[k].end - r[k].start > r[longest].end - r[longest].start)
+					longest = k;
+			}
+			double total = (double) (last - first);
+			std::streamsize precision = out.precision();
 
-	std::cout << deco.Rx();
+			out << std::left << std::setw(8) << "thread" << std::setw(width + 2) << "phase"
+				<< std::right << std::setw(14) << "start (s)" << std::setw(14) << "duration (s)"
+				<< std::setw(9) << "%";
+			if (counting)
+				out << std::setw(7) << "IPC" << std::setw(15) << "cache misses" << std::setw(15) << "branch misses";
+			out << '\n';
+			for (size_t k=0; k<r.size(); k++) {
+				double d = (double) (r[k].end - r[k].start);
+				out << std::left << std::setw(8) << r[k].thread
+					<< std::string(2 * r[k].depth, ' ') << std::setw(width + 2 - 2 * r[k].depth) << r[k].name
+					<< std::right << std::fixed << std::setprecision(9)
+					<< std::setw(14) << (r[k].start - first) * 1e-9 << std::setw(14) << d * 1e-9
+					<< std::setprecision(2) << std::setw(9) << (total > 0? d / total * 100.0 : 0.0);
+				if (counting) {
+					if (has(r[k], CYCLES) && has(r[k], INSTRUCTIONS) && r[k].counter[CYCLES] > 0)
+						out << std::setw(7) << (double) r[k].counter[INSTRUCTIONS] / r[k].counter[CYCLES];
+					else
+						out << std::setw(7) << '-';
+					for (int c=CACHE_MISSES; c<=BRANCH_MISSES; c++)
+						if (has(r[k], c))
+							out << std::setw(15) << r[k].counter[c];
+						else
+							out << std::setw(15) << '-';
+				}
+				out << '\n';
+			}
+			if (! r.empty())
+				out << "The longest outermost phase was \"" << r[longest].name << "\", "
+					<< std::setprecision(9) << (r[longest].end - r[longest].start) * 1e-9 << "s out of "
+					<< total * 1e-9 << "s." << std::endl;
+			out.unsetf(std::ios::fixed);
+			out.precision(precision);
+		}
 
-	for (int i=0; i<sp-1; i++) {
-		tnow = GetTime(i+1)-GetTime(i);
-		mnow = std::chrono::duration_cast<std::chrono::milliseconds>(tnow).count();
-		if (mnow > mmx) { mmx = mnow, mid = i; }
-		fprintf(f, format, i, GetString(i).c_str(), i+1, GetString(i+1).c_str()
+		// Closes the phase of Set() and writes the report (see SetFilename)
+		Boolean Write(void) {
+			if (setOpen) {
+				end(setBuf, setIndex);
+				setOpen = false;
+			}
+			written = true;
 
-			//, (f!=stdout)? "" : deco.Lxc(YELLOW,UNDERLINED)
-			, (double) mnow/1000.0
-			//, (f!=stdout)? "" : deco.Rxc()
+			std::ofstream file;
+			if (! outputFile.empty()) {
+				file.open(outputFile.c_str(), std::ios::trunc);
+				if (! file) {
+					std::cerr << "Phase: cannot write " << outputFile << '.' << std::endl;
+					return false;
+				}
+			}
+			std::ostream& out = outputFile.empty()? std::cout : file;
+			if (endsWith(outputFile, ".csv"))
+				WriteCSV(out);
+			else if (endsWith(outputFile, ".trace.json"))
+				WriteTrace(out);
+			else if (endsWith(outputFile, ".json"))
+				WriteJSON(out);
+			else
+				WriteTable(out);
+			return (Boolean) out;
+		}
+
+		Phase(const Phase&) = delete;
+		Phase& operator=(const Phase&) = delete;
+
+	private:
+		// The phases of one thread, open or closed (end == 0), in the order they were opened
+		struct Buffer {
+			uint64_t owner;			// ThreadSerial() of the thread
+			int thread;
+			int order;				// of the track in the trace events
+			int depth;
+			std::string name;
+			std::vector<Record_t> records;
+			int fd[N_COUNTERS];		// perf_event_open(2) counters of the thread; fd[0] leads the group
+
+			Buffer() : owner(ThreadSerial()), thread(0), order(0), depth(0) { for (int k=0; k<N_COUNTERS; k++) fd[k] = -1; }
+			~Buffer() { closeCounters(); }
+			void closeCounters(void) {
+				for (int k=0; k<N_COUNTERS; k++) {
+#ifdef __linux__
+					if (fd[k] >= 0)
+						::close(fd[k]);
+#endif
+					fd[k] = -1;
+				}
+			}
+		};
+
+		std::chrono::steady_clock::time_point epoch;
+		uint64_t serial;				// tells this object apart from a former one at the same address
+		Boolean counting;				// set by EnableCounters()
+
+		std::mutex registry;			// guards buffers
+		std::vector< std::unique_ptr<Buffer> > buffers;
+
+		Buffer* setBuf;
+		size_t setIndex;
+		Boolean setOpen;
+		std::string outputFile;
+		Boolean written;
+
+		uint64_t now(void) const {
+			return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - epoch).count() + 1;	// 0 marks open phases
+		}
+
+		// The buffer of the calling thread: a thread-local cache of the last few Phase objects
+		// the thread recorded into, most recent first, in front of the registry, which is
+		// searched for a buffer of the thread before a new one is made
+		Buffer* buffer(void) {
+			enum { CACHED = 4 };
+			static thread_local struct { uint64_t serial; Buffer* buf; } cache[CACHED] = {};
+			int k;
+
+			if (cache[0].serial == serial)
+				return cache[0].buf;
+			for (k=1; k<CACHED - 1 && cache[k].serial != serial; k++)
+				;
+			if (cache[k].serial != serial) {		// evict the least recent entry, k = CACHED-1
+				std::lock_guard<std::mutex> lock(registry);
+				size_t t;
+				for (t=0; t<buffers.size() && buffers[t]->owner != ThreadSerial(); t++)
+					;
+				if (t == buffers.size()) {
+					buffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+					buffers.back()->thread = buffers.back()->order = (int) t;
+					if (ThreadDefaults().set) {
+						buffers.back()->name = ThreadDefaults().name;
+						buffers.back()->order = ThreadDefaults().order;
+					}
+					if (counting && openCounters(buffers.back().get()) != 0)
+						buffers.back()->closeCounters();	// this thread's phases are only timed
+				}
+				cache[k].serial = serial;
+				cache[k].buf = buffers[t].get();
+			}
+			for (; k > 0; k--)
+				std::swap(cache[k], cache[k - 1]);
+			return cache[0].buf;
+		}
+
+		size_t begin(const std::string& name, Buffer*& buf) {
+			buf = buffer();
+			Record_t r;
+			r.name = name;
+			r.thread = buf->thread;
+			r.depth = buf->depth++;
+			r.end = 0;
+			r.counted = 0;
+			buf->records.push_back(r);
+			Record_t& b = buf->records.back();		// not counting the push_back
+			if (counting)
+				b.counted = readCounters(buf, b.counter);
+			b.start = now();
+			return buf->records.size() - 1;
+		}
+		void end(Buffer* buf, size_t index) {
+			Record_t& r = buf->records[index];
+			r.end = now();
+			if (r.counted) {
+				uint64_t v[N_COUNTERS];
+				r.counted &= readCounters(buf, v);
+				for (int k=0; k<N_COUNTERS; k++)
+					r.counter[k] = v[k] - r.counter[k];
+			}
+			buf->depth--;
+		}
+
+		// Opens the counters of the calling thread; returns 0, or the errno of the group leader.
+		// The other counters are optional (fd[k] < 0 if the CPU does not have them).
+		static int openCounters(Buffer* b) {
+#ifdef __linux__
+			static const uint64_t config[N_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+			struct perf_event_attr a;
+
+			for (int k=0; k<N_COUNTERS; k++) {
+				memset(& a, 0, sizeof(a));
+				a.size = sizeof(a);
+				a.type = PERF_TYPE_HARDWARE;
+				a.config = config[k];
+				a.exclude_kernel = 1;	// allowed by perf_event_paranoid up to 2
+				a.exclude_hv = 1;
+				a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				b->fd[k] = (int) syscall(__NR_perf_event_open, & a, 0, -1, k? b->fd[0] : -1, 0UL);
+				if (b->fd[0] < 0)
+					return errno;
+			}
+			return 0;
+#else
+			(void) b;
+			return ENOSYS;
+#endif
+		}
 
-			//, (f!=stdout)? "" : deco.Lxc(BLUE,NORMAL)
-			, (double) mnow / mall * 100.0
-			//, (f!=stdout)? "" : deco.Rxc()
+		// Reads the counters of b into v, scaled up if the kernel multiplexed them; returns the
+		// mask of the counters read
+		static unsigned readCounters(Buffer* b, uint64_t* v) {
+#ifdef __linux__
+			uint64_t data[3 + N_COUNTERS];		// number of counters, time enabled, time running, counters
+			if (b->fd[0] < 0 || ::read(b->fd[0], data, sizeof(data)) < (ssize_t) (3 * sizeof(uint64_t))
+					|| data[2] == 0)
+				return 0;
+			double scale = (data[2] < data[1])? (double) data[1] / data[2] : 1.0;
+			unsigned mask = 0;
+			for (int k=0, n=0; k<N_COUNTERS; k++)
+				if (b->fd[k] >= 0 && (uint64_t) n < data[0]) {
+					v[k] = (uint64_t) (data[3 + n++] * scale);
+					mask |= 1u << k;
+				}
+			return mask;
+#else
+			(void) b, (void) v;
+			return 0;
+#endif
+		}
+
+		static Boolean has(const Record_t& r, int k) { return (r.counted >> k) & 1; }
 
-		);
-	}
+		// The known counters of r as JSON members, each preceded by a comma
+		static std::string counters(const Record_t& r) {
+			std::ostringstream q;
+			for (int k=0; k<N_COUNTERS; k++)
+				if (has(r, k))
+					q << ",\"" << CounterName(k) << "\":" << r.counter[k];
+			return q.str();
+		}
 
-	tnow = GetTime(mid+1)-GetTime(mid);
-	mnow = std::chrono::duration_cast<std::chrono::milliseconds>(tnow).count();
-	std::cout << "\nThe longest lasting phase was phase " << mid << " (\"" 
-			<< GetString(mid) << "\"), which took "
-			<< mnow / 1000.0 << "s out of a total of " << mall / 1000.0 << "s, "
-			<< "or 1 / " << (double) mall / mnow << "th of the total time." << std::endl;
-	if (f != stdout) fclose(f);
-}
+		// A static data member would need a definition in a translation unit
+		static std::atomic<uint64_t>& Serials(void) { static std::atomic<uint64_t> s(0); return s; }
 
+		// Set by SetDefaultThreadName()
+		typedef struct { std::string name; int order; Boolean set; } ThreadDefaults_t;
+		static ThreadDefaults_t& ThreadDefaults(void) {
+			static thread_local ThreadDefaults_t defaults = { std::string(), 0, false };
+			return defaults;
+		}
+
+		// Tells the calling thread apart from the former threads, unlike std::thread::id, which
+		// may be reused once a thread has exited
+		static uint64_t ThreadSerial(void) {
+			static std::atomic<uint64_t> threads(0);
+			static thread_local uint64_t self = ++threads;
+			return self;
+		}
+
+		static Boolean endsWith(const std::string& s, const char* suffix) {
+			std::string x(suffix);
+			return s.length() >= x.length() && s.compare(s.length() - x.length(), x.length(), x) == 0;
+		}
+		static std::string csv(const std::string& s) {
+			if (s.find_first_of(",\"\n") == std::string::npos)
+				return s;
+			std::string q = "\"";
+			for (size_t k=0; k<s.length(); k++)
+				q += (s[k] == '"')? std::string("\"\"") : std::string(1, s[k]);
+			return q + "\"";
+		}
+		static std::string json(const std::string& s) {
+			std::ostringstream q;
+			q << '"';
+			for (size_t k=0; k<s.length(); k++) {
+				unsigned char c = (unsigned char) s[k];
+				if (c == '"' || c == '\\')
+					q << '\\' << c;
+				else if (c < 0x20)
+					q << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec;
+				else
+					q << c;
+			}
+			q << '"';
+			return q.str();
+		}
+};
 
+#endif /* __PHASE_H__ */
@@ -5,11 +5,14 @@
 # include <fstream>
 # include <cmath>
 # include <ctime>
+# include <cstdlib>
+# include <vector>
 
 
 using namespace std;
 
 # include "ppmb_io.hpp"
+# include "GSPixelKernels.h"
 
 //****************************************************************************80
 
@@ -93,6 +96,431 @@ int i4_max ( int i1, int i2 )
 }
 //****************************************************************************80
 
+bool pnmb_read ( string input_name, int &xsize, int &ysize, int &maxval,
+  int &channels, unsigned short **data )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    PNMB_READ reads a binary portable graymap or pixel map file, of 8 or 16
+//    bits per sample.
+//
+//  Discussion:
+//
+//    The samples are returned as unsigned shorts, channel after channel:
+//    channel K of pixel (I,J) is (*DATA)[(K*YSIZE+J)*XSIZE+I].  The caller
+//    frees *DATA with delete [].
+//
+//  Licensing:
+//
+//    This code is distributed under the GNU LGPL license. 
+//
+//  Modified:
+//
+//    22 October 2016
+//
+//  Author:
+//
+//    Eidon
+//
+//  Parameters:
+//
+//    Input, string INPUT_NAME, the name of the file.
+//
+//    Output, int &XSIZE, &YSIZE, the number of rows and columns of data.
+//
+//    Output, int &MAXVAL, the maximum sample value.
+//
+//    Output, int &CHANNELS, 1 for a graymap, 3 for a pixel map.
+//
+//    Output, unsigned short **DATA, the CHANNELS planes of XSIZE by YSIZE
+//    samples.
+//
+//    Output, bool PNMB_READ, is true if there was an error.
+//
+{
+  int k;
+  ifstream input;
+  unsigned short *planes[3];
+
+  *data = NULL;
+  input.open ( input_name.c_str ( ), ios::binary );
+
+  if ( !input )
+  {
+    cout << "\n";
+    cout << "PNMB_READ - Fatal error!\n";
+    cout << "  Cannot open the input file \"" << input_name << "\".\n";
+    return true;
+  }
+
+  if ( pnmb_read_header ( input, channels, xsize, ysize, maxval ) )
+  {
+    cout << "\n";
+    cout << "PNMB_READ - Fatal error!\n";
+    cout << "  PNMB_READ_HEADER failed.\n";
+    return true;
+  }
+
+  *data = new unsigned short[( size_t ) channels * xsize * ysize];
+  for ( k = 0; k < channels; k++ )
+  {
+    planes[k] = *data + ( size_t ) k * xsize * ysize;
+  }
+
+  if ( pnmb_read_data ( input, xsize, ysize, channels, maxval, planes ) )
+  {
+    cout << "\n";
+    cout << "PNMB_READ - Fatal error!\n";
+    cout << "  PNMB_READ_DATA failed.\n";
+    delete [] *data;
+    *data = NULL;
+    return true;
+  }
+
+  input.close ( );
+
+  return false;
+}
+//****************************************************************************80
+
+bool pnmb_read_data ( ifstream &input, int xsize, int ysize, int channels,
+  int maxval, unsigned short **planes )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    PNMB_READ_DATA reads the data of a binary portable graymap or pixel map
+//    file into planar buffers.
+//
+//  Discussion:
+//
+//    The data is read one scanline at a time, with a single block read.
+//    Samples take one byte if MAXVAL <= 255, and two bytes, most significant
+//    byte first, otherwise.
+//
+//  Licensing:
+//
+//    This code is distributed under the GNU LGPL license. 
+//
+//  Modified:
+//
+//    22 October 2016
+//
+//  Author:
+//
+//    Eidon
+//
+//  Parameters:
+//
+//    Input, ifstream &INPUT, a pointer to the file, past its header.
+//
+//    Input, int XSIZE, YSIZE, the number of rows and columns of data.
+//
+//    Input, int CHANNELS, the number of samples per pixel (1 or 3).
+//
+//    Input, int MAXVAL, the maximum sample value.
+//
+//    Output, unsigned short **PLANES, CHANNELS caller-provided arrays of
+//    XSIZE by YSIZE samples.
+//
+//    Output, bool PNMB_READ_DATA, is true if an error occurred.
+//
+{
+  int bytes;
+  int i;
+  int j;
+  int k;
+  const unsigned char *p;
+  vector<unsigned char> line;
+
+  bytes = ( maxval <= 255 ) ? 1 : 2;
+  line.resize ( ( size_t ) bytes * channels * xsize );
+
+  for ( j = 0; j < ysize; j++ )
+  {
+    input.read ( ( char * ) &line[0], line.size ( ) );
+
+    if ( input.gcount ( ) != ( streamsize ) line.size ( ) )
+    {
+      cout << "\n";
+      cout << "PNMB_READ_DATA - Fatal error!\n";
+      cout << "  End of file reading row " << j << ".\n";
+      return true;
+    }
+
+    p = &line[0];
+    for ( i = 0; i < xsize; i++ )
+    {
+      for ( k = 0; k < channels; k++ )
+      {
+        if ( bytes == 1 )
+        {
+          planes[k][( size_t ) j * xsize + i] = *p;
+        }
+        else
+        {
+          planes[k][( size_t ) j * xsize + i] = ( unsigned short ) ( ( p[0] << 8 ) | p[1] );
+        }
+        p = p + bytes;
+      }
+    }
+  }
+  return false;
+}
+//****************************************************************************80
+
+bool pnmb_read_header ( ifstream &input, int &channels, int &xsize, int &ysize,
+  int &maxval )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    PNMB_READ_HEADER reads the header of a binary portable graymap (P5) or
+//    pixel map (P6) file.
+//
+//  Discussion:
+//
+//    MAXVAL may be up to 65535; above 255, each sample of the data takes
+//    two bytes, most significant byte first.
+//
+//  Licensing:
+//
+//    This code is distributed under the GNU LGPL license. 
+//
+//  Modified:
+//
+//    22 October 2016
+//
+//  Author:
+//
+//    John Burkardt, Eidon
+//
+//  Parameters:
+//
+//    Input, ifstream &INPUT, a pointer to the file.
+//
+//    Output, int &CHANNELS, 1 for a graymap, 3 for a pixel map.
+//
+//    Output, int &XSIZE, &YSIZE, the number of rows and columns of data.
+//
+//    Output, int &MAXVAL, the maximum sample value.
+//
+//    Output, bool PNMB_READ_HEADER, is true if an error occurred.
+//
+{
+  string line;
+  string rest;
+  int step;
+  string word;
+
+  step = 0;
+
+  while ( 1 )
+  {
+    getline ( input, line );
+
+    if ( input.eof ( ) )
+    {
+      cout << "\n";
+      cout << "PNMB_READ_HEADER - Fatal error!\n";
+      cout << "  End of file.\n";
+      return true;
+    }
+
+    if ( line[0] == '#' )
+    {
+      continue;
+    }
+
+    if ( step == 0 )
+    {
+      s_word_extract_first ( line, word, rest );
+
+      if ( s_len_trim ( word ) <= 0 )
+      {
+        continue;
+      }
+
+      if ( s_eqi ( word, "P5" ) )
+      {
+        channels = 1;
+      }
+      else if ( s_eqi ( word, "P6" ) )
+      {
+        channels = 3;
+      }
+      else
+      {
+        cout << "\n";
+        cout << "PNMB_READ_HEADER - Fatal error.\n";
+        cout << "  Bad magic number = \"" << word << "\".\n";
+        return true;
+      }
+      line = rest;
+      step = 1;
+    }
+
+    if ( step == 1 )
+    {
+      s_word_extract_first ( line, word, rest );
+ 
+      if ( s_len_trim ( word ) <= 0 )
+      {
+        continue;
+      }
+      xsize = atoi ( word.c_str ( ) );
+      line = rest;
+      step = 2;
+    }
+
+    if ( step == 2 )
+    {
+      s_word_extract_first ( line, word, rest );
+
+      if ( s_len_trim ( word ) <= 0 )
+      {
+        continue;
+      }
+      ysize = atoi ( word.c_str ( ) );
+      line = rest;
+      step = 3;
+    }
+
+    if ( step == 3 )
+    {
+      s_word_extract_first ( line, word, rest );
+
+      if ( s_len_trim ( word ) <= 0 )
+      {
+        continue;
+      }
+      maxval = atoi ( word.c_str ( ) );
+      line = rest;
+      break;
+    }
+
+  }
+
+  if ( xsize <= 0 || ysize <= 0 || maxval <= 0 || 65535 < maxval )
+  {
+    cout << "\n";
+    cout << "PNMB_READ_HEADER - Fatal error.\n";
+    cout << "  Bad size or maximum value.\n";
+    return true;
+  }
+
+  return false;
+}
+
+//****************************************************************************80
+
+bool pnmb_write ( string output_name, int xsize, int ysize, int channels,
+  int maxval, unsigned short **planes )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    PNMB_WRITE writes a binary portable graymap or pixel map file, of 8 or
+//    16 bits per sample.
+//
+//  Licensing:
+//
+//    This code is distributed under the GNU LGPL license. 
+//
+//  Modified:
+//
+//    22 October 2016
+//
+//  Author:
+//
+//    Eidon
+//
+//  Parameters:
+//
+//    Input, string OUTPUT_NAME, the name of the file.
+//
+//    Input, int XSIZE, YSIZE, the number of rows and columns of data.
+//
+//    Input, int CHANNELS, 1 for a graymap (P5), 3 for a pixel map (P6).
+//
+//    Input, int MAXVAL, the maximum sample value, up to 65535.  Samples take
+//    two bytes if it is above 255.
+//
+//    Input, unsigned short **PLANES, CHANNELS arrays of XSIZE by YSIZE
+//    samples.
+//
+//    Output, bool PNMB_WRITE, is true if an error occurred.
+//
+{
+  int bytes;
+  int i;
+  int j;
+  int k;
+  unsigned char *p;
+  unsigned short v;
+  vector<unsigned char> line;
+  ofstream output;
+
+  output.open ( output_name.c_str ( ), ios::binary );
+
+  if ( !output )
+  {
+    cout << "\n";
+    cout << "PNMB_WRITE: Fatal error!\n";
+    cout << "  Cannot open the output file " << output_name << ".\n";
+    return true;
+  }
+
+  output << ( channels == 1 ? "P5" : "P6" ) << " "
+         << xsize  << " "
+         << ysize  << " "
+         << maxval << "\n";
+
+  bytes = ( maxval <= 255 ) ? 1 : 2;
+  line.resize ( ( size_t ) bytes * channels * xsize );
+
+  for ( j = 0; j < ysize; j++ )
+  {
+    p = &line[0];
+    for ( i = 0; i < xsize; i++ )
+    {
+      for ( k = 0; k < channels; k++ )
+      {
+        v = planes[k][( size_t ) j * xsize + i];
+        if ( bytes == 1 )
+        {
+          *p = ( unsigned char ) v;
+        }
+        else
+        {
+          p[0] = ( unsigned char ) ( v >> 8 );
+          p[1] = ( unsigned char ) ( v & 0xff );
+        }
+        p = p + bytes;
+      }
+    }
+    output.write ( ( char * ) &line[0], line.size ( ) );
+  }
+
+  if ( !output )
+  {
+    cout << "\n";
+    cout << "PNMB_WRITE: Fatal error!\n";
+    cout << "  Write error on " << output_name << ".\n";
+    return true;
+  }
+
+  output.close ( );
+
+  return false;
+}
+//****************************************************************************80
+
 bool ppmb_check_data ( int xsize, int ysize, int maxrgb, unsigned char *r,
   unsigned char *g, unsigned char *b )
 
@@ -416,13 +844,17 @@ bool ppmb_read_data ( ifstream &input, int xsize, int ysize,
 //    If the ordinary ">>" operator is used to input the data, then data that
 //    happens to look like new lines or other white space is skipped.
 //
+//    The data is read one scanline at a time, with a single block read,
+//    and split into the R, G and B arrays by GSDeinterleave3.  Any of
+//    R, G and B may be NULL, in which case that channel is skipped.
+//
 //  Licensing:
 //
 //    This code is distributed under the GNU LGPL license. 
 //
 //  Modified:
 //
-//    17 December 2004
+//    22 October 2016
 //
 //  Author:
 //
@@ -441,69 +873,34 @@ bool ppmb_read_data ( ifstream &input, int xsize, int ysize,
 //    Output, bool PPMB_READ_DATA, is true if an error occurred.
 //
 {
-  char c;
-  bool error;
   int i;
-  unsigned char *indexb;
-  unsigned char *indexg;
-  unsigned char *indexr;
   int j;
-  int k;
+  vector<unsigned char> line ( 3 * ( size_t ) xsize );
+  vector<unsigned char> skip;
 
-  indexr = r;
-  indexg = g;
-  indexb = b;
+  if ( r == NULL || g == NULL || b == NULL )
+  {
+    skip.resize ( xsize );
+  }
 
   for ( j = 0; j < ysize; j++ )
   {
-    for ( i = 0; i < xsize; i++ )
-    {
-      input.read ( &c, 1 );
-	  if (indexr) {
-        *indexr = ( unsigned char ) c;
-         indexr = indexr + 1;
-	  }
-      error = input.eof();
-      if ( error )
-      {
-        cout << "\n";
-        cout << "PPMB_READ_DATA - Fatal error!\n";
-        cout << "  End of file reading R byte of pixel (" 
-          << i << ", " << j <<") \n";
-        return true;
-      }
-
-      input.read ( &c, 1 );
-	  if (indexg) {
-        *indexg = ( unsigned char ) c;
-         indexg = indexg + 1;
-	  }
-      error = input.eof();
-      if ( error )
-      {
-        cout << "\n";
-        cout << "PPMB_READ_DATA - Fatal error!\n";
-        cout << "  End of file reading G byte of pixel (" 
-          << i << ", " << j <<") \n";
-        return true;
-      }
-
-      input.read ( &c, 1 );
-	  if (indexb) {
-        *indexb = ( unsigned char ) c;
-        indexb = indexb + 1;
-	  }
-      error = input.eof();
-      if ( error )
-      {
-        cout << "\n";
-        cout << "PPMB_READ_DATA - Fatal error!\n";
-        cout << "  End of file reading B byte of pixel (" 
-          << i << ", " << j <<") \n";
-        return true;
-      }
+    input.read ( ( char * ) &line[0], line.size ( ) );
 
+    if ( input.gcount ( ) != ( streamsize ) line.size ( ) )
+    {
+      i = ( int ) ( input.gcount ( ) / 3 );
+      cout << "\n";
+      cout << "PPMB_READ_DATA - Fatal error!\n";
+      cout << "  End of file reading pixel (" 
+        << i << ", " << j <<") \n";
+      return true;
     }
+
+    GSDeinterleave3 ( &line[0],
+      r ? r + ( size_t ) j * xsize : &skip[0],
+      g ? g + ( size_t ) j * xsize : &skip[0],
+      b ? b + ( size_t ) j * xsize : &skip[0], xsize );
   }
   return false;
 }
@@ -523,7 +920,7 @@ bool ppmb_read_header ( ifstream &input, int &xsize, int &ysize, int &maxrgb )
 //
 //  Modified:
 //
-//    22 July 2011
+//    22 October 2016
 //
 //  Author:
 //
@@ -541,93 +938,30 @@ bool ppmb_read_header ( ifstream &input, int &xsize, int &ysize, int &maxrgb )
 //    Output, bool PPMB_READ_HEADER, is true if an error occurred.
 //
 {
-  int count;
-  int fred;
-  string line;
-  string rest;
-  int step;
-  int width;
-  string word;
-
-  step = 0;
+  int channels;
 
-  while ( 1 )
+  if ( pnmb_read_header ( input, channels, xsize, ysize, maxrgb ) )
   {
-    getline ( input, line );
-
-    if ( input.eof ( ) )
-    {
-      cout << "\n";
-      cout << "PPMB_READ_HEADER - Fatal error!\n";
-      cout << "  End of file.\n";
-      return true;
-    }
-
-    if ( line[0] == '#' )
-    {
-      continue;
-    }
-
-    if ( step == 0 )
-    {
-      s_word_extract_first ( line, word, rest );
-
-      if ( s_len_trim ( word ) <= 0 )
-      {
-        continue;
-      }
-
-      if ( !s_eqi ( word, "P6" ) )
-      {
-        cout << "\n";
-        cout << "PPMB_READ_HEADER - Fatal error.\n";
-        cout << "  Bad magic number = \"" << word << "\".\n";
-        return true;
-      }
-      line = rest;
-      step = 1;
-    }
-
-    if ( step == 1 )
-    {
-      s_word_extract_first ( line, word, rest );
- 
-      if ( s_len_trim ( word ) <= 0 )
-      {
-        continue;
-      }
-      xsize = atoi ( word.c_str ( ) );
-      line = rest;
-      step = 2;
-    }
-
-    if ( step == 2 )
-    {
-      s_word_extract_first ( line, word, rest );
-
-      if ( s_len_trim ( word ) <= 0 )
-      {
-        continue;
-      }
-      ysize = atoi ( word.c_str ( ) );
-      line = rest;
-      step = 3;
-    }
-
-    if ( step == 3 )
-    {
-      s_word_extract_first ( line, word, rest );
-
-      if ( s_len_trim ( word ) <= 0 )
-      {
-        continue;
-      }
-      fred = atoi ( word.c_str ( ) );
-      maxrgb = ( unsigned char ) fred;
-      line = rest;
-      break;
-    }
+    return true;
+  }
 
+  if ( channels != 3 )
+  {
+    cout << "\n";
+    cout << "PPMB_READ_HEADER - Fatal error.\n";
+    cout << "  The file is a graymap, not a pixel map.\n";
+    return true;
+  }
+//
+//  PPMB_READ_DATA reads one byte per sample; PNMB_READ handles 16 bit samples.
+//
+  if ( 255 < maxrgb )
+  {
+    cout << "\n";
+    cout << "PPMB_READ_HEADER - Fatal error.\n";
+    cout << "  The maximum RGB value " << maxrgb << " exceeds 255.\n";
+    cout << "  Use PNMB_READ for pixel maps of 16 bits per sample.\n";
+    return true;
   }
 
   return false;
@@ -830,13 +1164,18 @@ bool ppmb_write_data ( ofstream &output, int xsize, int ysize,
 //
 //    PPMB_WRITE_DATA writes the data for a binary portable pixel map file.
 //
+//  Discussion:
+//
+//    The R, G and B arrays are interleaved by GSInterleave3 and written
+//    one scanline at a time, with a single block write.
+//
 //  Licensing:
 //
 //    This code is distributed under the GNU LGPL license. 
 //
 //  Modified:
 //
-//    11 April 2003
+//    22 October 2016
 //
 //  Author:
 //
@@ -855,27 +1194,22 @@ bool ppmb_write_data ( ofstream &output, int xsize, int ysize,
 //    Output, bool PPMB_WRITE_DATA, is true if an error occurred.
 //
 {
-  int  i;
-  unsigned char *indexb;
-  unsigned char *indexg;
-  unsigned char *indexr;
-  int  j;
-
-  indexr = r;
-  indexg = g;
-  indexb = b;
+  int j;
+  vector<unsigned char> line ( 3 * ( size_t ) xsize );
 
   for ( j = 0; j < ysize; j++ )
   {
-    for ( i = 0; i < xsize; i++ )
-    {
-      output << *indexr;
-      indexr = indexr + 1;
-      output << *indexg;
-      indexg = indexg + 1;
-      output << *indexb;
-      indexb = indexb + 1;
-    }
+    GSInterleave3 ( r + ( size_t ) j * xsize, g + ( size_t ) j * xsize,
+      b + ( size_t ) j * xsize, &line[0], xsize );
+    output.write ( ( char * ) &line[0], line.size ( ) );
+  }
+
+  if ( !output )
+  {
+    cout << "\n";
+    cout << "PPMB_WRITE_DATA - Fatal error!\n";
+    cout << "  Write error.\n";
+    return true;
   }
   return false;
 }
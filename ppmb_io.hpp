@@ -3,6 +3,15 @@ char ch_cap ( char ch );
 
 int i4_max ( int i1, int i2 );
 
+bool pnmb_read ( string file_in_name, int &xsize, int &ysize, int &maxval,
+  int &channels, unsigned short **data );
+bool pnmb_read_data ( ifstream &file_in, int xsize, int ysize, int channels,
+  int maxval, unsigned short **planes );
+bool pnmb_read_header ( ifstream &file_in, int &channels, int &xsize, int &ysize,
+  int &maxval );
+bool pnmb_write ( string file_out_name, int xsize, int ysize, int channels,
+  int maxval, unsigned short **planes );
+
 bool ppmb_check_data ( int xsize, int ysize, int maxrgb, unsigned char *r,
   unsigned char *g, unsigned char *b );
 